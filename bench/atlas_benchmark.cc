@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+#include "../src/SkylineAtlas.cpp"
+#include "../src/MaxRectsAtlas.cpp"
+
+// Packs sprite-size distributions into a page with each packer and reports insert time and
+// occupancy. Pass a file of recorded "width height" lines to replace the built-in samples.
+//
+//   atlas_benchmark [recorded_sizes.txt] [page_size]
+
+class SizeListSource : public TextureSource {
+public:
+	std::vector<unsigned int> widths;
+	std::vector<unsigned int> heights;
+
+	bool getSize (const unsigned long textureID, unsigned int& width, unsigned int& height) {
+		if (textureID >= widths.size()) {
+			return false;
+		}
+		width = widths[textureID];
+		height = heights[textureID];
+		return true;
+	}
+};
+
+struct SizeBucket {
+	unsigned int width;
+	unsigned int height;
+	unsigned int weight;
+};
+
+struct Distribution {
+	const char* name;
+	const SizeBucket* buckets;
+	size_t bucketCount;
+};
+
+static const SizeBucket kUiIcons[] = { { 16, 16, 30 }, { 24, 24, 25 }, { 32, 32, 25 }, { 48, 48, 10 }, { 64, 64, 6 }, { 128, 32, 4 } };
+static const SizeBucket kCharacters[] = { { 48, 64, 20 }, { 64, 96, 30 }, { 96, 128, 25 }, { 128, 128, 15 }, { 200, 180, 10 } };
+static const SizeBucket kMixed[] = { { 8, 8, 15 }, { 17, 33, 15 }, { 40, 24, 15 }, { 64, 64, 15 }, { 90, 50, 15 }, { 130, 70, 10 }, { 256, 128, 5 }, { 31, 190, 10 } };
+
+static double nowMs() {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+static void sample(const Distribution& distribution, const size_t count, SizeListSource& source) {
+	unsigned int total = 0;
+	for (size_t i = 0; i < distribution.bucketCount; ++i) {
+		total += distribution.buckets[i].weight;
+	}
+
+	unsigned int seed = 2013;
+	for (size_t i = 0; i < count; ++i) {
+		seed = seed * 1103515245 + 12345;
+		unsigned int pick = (seed >> 8) % total;
+		size_t bucket = 0;
+		while (pick >= distribution.buckets[bucket].weight) {
+			pick -= distribution.buckets[bucket].weight;
+			++bucket;
+		}
+		source.widths.push_back(distribution.buckets[bucket].width);
+		source.heights.push_back(distribution.buckets[bucket].height);
+	}
+}
+
+static void run(const char* distribution, const char* packer, PackedAtlas& atlas, const size_t count) {
+	double start = nowMs();
+	size_t placed = 0;
+	for (unsigned long textureID = 0; textureID < count; ++textureID) {
+		if (atlas.willFit(textureID) && atlas.addTexture(textureID)) {
+			++placed;
+		}
+	}
+	double elapsed = nowMs() - start;
+
+	printf("%-12s %-9s %8lu %8lu %10.3f %10.3f %9.2f%%\n", distribution, packer, (unsigned long)count, (unsigned long)placed,
+		elapsed, count ? elapsed * 1000.0 / count : 0.0, atlas.occupancy() * 100.0f);
+}
+
+static void benchmark(const char* name, SizeListSource& source, const unsigned int pageSize) {
+	SkylineAtlas skyline(&source, pageSize, pageSize);
+	run(name, "skyline", skyline, source.widths.size());
+
+	MaxRectsAtlas maxRects(&source, pageSize, pageSize);
+	run(name, "maxrects", maxRects, source.widths.size());
+}
+
+int main(int argc, char** argv) {
+	const unsigned int pageSize = argc > 2 ? (unsigned int)atoi(argv[2]) : 2048;
+
+	printf("%-12s %-9s %8s %8s %10s %10s %10s\n", "sizes", "packer", "inserts", "placed", "total ms", "us/insert", "occupancy");
+
+	if (argc > 1) {
+		FILE* recorded = fopen(argv[1], "r");
+		if (!recorded) {
+			fprintf(stderr, "cannot open %s\n", argv[1]);
+			return 1;
+		}
+		SizeListSource source;
+		unsigned int width, height;
+		while (fscanf(recorded, "%u %u", &width, &height) == 2) {
+			source.widths.push_back(width);
+			source.heights.push_back(height);
+		}
+		fclose(recorded);
+		benchmark("recorded", source, pageSize);
+		return 0;
+	}
+
+	const Distribution distributions[] = {
+		{ "ui-icons", kUiIcons, sizeof(kUiIcons) / sizeof(kUiIcons[0]) },
+		{ "characters", kCharacters, sizeof(kCharacters) / sizeof(kCharacters[0]) },
+		{ "mixed", kMixed, sizeof(kMixed) / sizeof(kMixed[0]) }
+	};
+	for (size_t i = 0; i < sizeof(distributions) / sizeof(distributions[0]); ++i) {
+		SizeListSource source;
+		sample(distributions[i], 4000, source);
+		benchmark(distributions[i].name, source, pageSize);
+	}
+	return 0;
+}
@@ -0,0 +1,103 @@
+#ifndef ATLAS_BLOCKS_CPP
+#define ATLAS_BLOCKS_CPP
+
+#include <vector>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// CPU copy of block-compressed atlas pages (BCn, ETC and the like): a page is a grid of
+// blockSize x blockSize blocks of bytesPerBlock bytes, stored row of blocks by row of blocks.
+// Rects must sit on block boundaries, which PackedAtlas guarantees in block-aligned mode, so
+// every copy moves whole blocks: one memcpy per row of blocks, never a decode.
+class AtlasBlocks {
+public:
+	inline AtlasBlocks(const unsigned int width, const unsigned int height, const unsigned int blockSize, const unsigned int bytesPerBlock) :
+		m_width(width),
+		m_height(height),
+		m_blockSize(blockSize),
+		m_bytesPerBlock(bytesPerBlock)
+	{};
+
+	void blit (const unsigned int page, const unsigned int x, const unsigned int y, const unsigned int width, const unsigned int height, const uint8_t* source, const size_t sourceStride);
+	void extrude (const unsigned int page, const unsigned int x, const unsigned int y, const unsigned int width, const unsigned int height, const unsigned int gutter);
+	void copy (const AtlasBlocks& source, const unsigned int sourcePage, const unsigned int sourceX, const unsigned int sourceY, const unsigned int width, const unsigned int height, const unsigned int page, const unsigned int x, const unsigned int y);
+	void ensurePages (const size_t pages);
+
+	inline size_t pageCount() const { return m_pages.size(); };
+	inline unsigned int blockSize() const { return m_blockSize; };
+	inline unsigned int bytesPerBlock() const { return m_bytesPerBlock; };
+	inline size_t rowBytes() const { return (size_t)(m_width / m_blockSize) * m_bytesPerBlock; };
+	// The block holding pixel (x, y).
+	inline const uint8_t* block (const unsigned int page, const unsigned int x, const unsigned int y) const { return &m_pages[page][offset(x, y)]; };
+
+private:
+	const unsigned int m_width;
+	const unsigned int m_height;
+	const unsigned int m_blockSize;
+	const unsigned int m_bytesPerBlock;
+	std::vector<std::vector<uint8_t> > m_pages;
+
+	inline size_t offset (const unsigned int x, const unsigned int y) const { return (size_t)(y / m_blockSize) * rowBytes() + (size_t)(x / m_blockSize) * m_bytesPerBlock; };
+	inline uint8_t* blockFor (const unsigned int page, const unsigned int x, const unsigned int y) { return &m_pages[page][offset(x, y)]; };
+	inline unsigned int blocks (const unsigned int pixels) const { return (pixels + m_blockSize - 1) / m_blockSize; };
+};
+
+// The image is ceil(width / blockSize) blocks per row, sourceStride bytes apart; a partial
+// block at the right or bottom edge is copied whole.
+void AtlasBlocks::blit (const unsigned int page, const unsigned int x, const unsigned int y, const unsigned int width, const unsigned int height, const uint8_t* source, const size_t sourceStride)
+{
+	ensurePages(page + 1);
+	const size_t bytes = (size_t)blocks(width) * m_bytesPerBlock;
+	for (unsigned int row = 0; row < blocks(height); ++row)
+	{
+		memcpy(blockFor(page, x, y + row * m_blockSize), source + row * sourceStride, bytes);
+	}
+}
+
+// Replicates the rect's edge blocks across the gutter, which must be whole blocks.
+void AtlasBlocks::extrude (const unsigned int page, const unsigned int x, const unsigned int y, const unsigned int width, const unsigned int height, const unsigned int gutter)
+{
+	if (!gutter || !width || !height)
+	{
+		return;
+	}
+
+	ensurePages(page + 1);
+	const unsigned int right = x + (blocks(width) - 1) * m_blockSize;
+	const unsigned int bottom = y + (blocks(height) - 1) * m_blockSize;
+	for (unsigned int row = y; row <= bottom; row += m_blockSize)
+	{
+		for (unsigned int i = m_blockSize; i <= gutter; i += m_blockSize)
+		{
+			memcpy(blockFor(page, x - i, row), blockFor(page, x, row), m_bytesPerBlock);
+			memcpy(blockFor(page, right + i, row), blockFor(page, right, row), m_bytesPerBlock);
+		}
+	}
+
+	const size_t bytes = (size_t)(blocks(width) + 2 * gutter / m_blockSize) * m_bytesPerBlock;
+	for (unsigned int i = m_blockSize; i <= gutter; i += m_blockSize)
+	{
+		memcpy(blockFor(page, x - gutter, y - i), blockFor(page, x - gutter, y), bytes);
+		memcpy(blockFor(page, x - gutter, bottom + i), blockFor(page, x - gutter, bottom), bytes);
+	}
+}
+
+// Copies a rect out of another store with the same geometry, e.g. when a repack moves it.
+void AtlasBlocks::copy (const AtlasBlocks& source, const unsigned int sourcePage, const unsigned int sourceX, const unsigned int sourceY, const unsigned int width, const unsigned int height, const unsigned int page, const unsigned int x, const unsigned int y)
+{
+	if (sourcePage < source.pageCount())
+	{
+		blit(page, x, y, width, height, source.block(sourcePage, sourceX, sourceY), source.rowBytes());
+	}
+}
+
+void AtlasBlocks::ensurePages (const size_t pages)
+{
+	while (m_pages.size() < pages)
+	{
+		m_pages.push_back(std::vector<uint8_t>(rowBytes() * (m_height / m_blockSize), 0));
+	}
+}
+
+#endif
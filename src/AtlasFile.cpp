@@ -0,0 +1,237 @@
+#ifndef ATLAS_FILE_CPP
+#define ATLAS_FILE_CPP
+
+#include <algorithm>
+#include <vector>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "PackedAtlas.cpp"
+
+// Baked atlas files, written offline by atlas_bake and mapped at startup. The layout is a
+// header, the texture table sorted by id, then every page's RGBA8 pixels with rows tightly
+// packed, starting on a 16-byte boundary. All fields are fixed-width and native byte order
+// (little-endian on every target we ship); a change to any of them bumps the version.
+static const uint32_t kAtlasFileMagic = 0x534c5441; // "ATLS"
+static const uint32_t kAtlasFileVersion = 1;
+
+struct AtlasFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t pageWidth;
+	uint32_t pageHeight;
+	uint32_t pageCount;
+	uint32_t textureCount;
+	uint64_t pagesOffset;
+};
+
+struct AtlasFileEntry {
+	uint64_t textureID;
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+	uint32_t layer;
+	uint32_t trimX;
+	uint32_t trimY;
+	uint32_t sourceWidth;
+	uint32_t sourceHeight;
+	float u0;
+	float v0;
+	float u1;
+	float v1;
+	uint32_t reserved;
+};
+
+// Writes the textures' placements and the atlas's backing store. Fails if the atlas has no
+// backing store or one of the textures is not in it.
+bool writeAtlasFile (const char* path, const PackedAtlas& atlas, const std::vector<unsigned long>& textureIDs);
+
+// A baked atlas file mapped read-only. Nothing is copied: open() checks the header and the
+// table, then entries and pages point straight into the mapping.
+class AtlasFile {
+public:
+	inline AtlasFile() : m_data(NULL), m_size(0) {};
+	inline ~AtlasFile() { close(); };
+
+	// False if the file cannot be mapped, is not an atlas file, has another version or is
+	// shorter than its header says, or if the table is not sorted by id or has an entry
+	// off its page.
+	bool open (const char* path);
+	void close();
+
+	inline bool isOpen() const { return m_data != NULL; };
+	inline const AtlasFileHeader& header() const { return *reinterpret_cast<const AtlasFileHeader*>(m_data); };
+	inline const AtlasFileEntry* entries() const { return reinterpret_cast<const AtlasFileEntry*>(m_data + sizeof(AtlasFileHeader)); };
+	inline const uint32_t* page (const unsigned int page) const { return reinterpret_cast<const uint32_t*>(m_data + header().pagesOffset) + (size_t)page * header().pageWidth * header().pageHeight; };
+	// Binary search of the sorted table.
+	const AtlasFileEntry* find (const unsigned long textureID) const;
+
+private:
+	const uint8_t* m_data;
+	size_t m_size;
+
+	bool isValid() const;
+
+	AtlasFile(const AtlasFile&);
+	AtlasFile& operator=(const AtlasFile&);
+};
+
+static inline bool isLowerID (const AtlasFileEntry& left, const AtlasFileEntry& right)
+{
+	return left.textureID < right.textureID;
+}
+
+bool writeAtlasFile (const char* path, const PackedAtlas& atlas, const std::vector<unsigned long>& textureIDs)
+{
+	const AtlasPixels* pixels = atlas.backingStore();
+	if (!pixels)
+	{
+		return false;
+	}
+
+	std::vector<AtlasFileEntry> entries;
+	entries.reserve(textureIDs.size());
+	for (size_t i = 0; i < textureIDs.size(); ++i)
+	{
+		const AtlasedTexture* texture = atlas.find(textureIDs[i]);
+		if (!texture)
+		{
+			return false;
+		}
+
+		AtlasFileEntry entry = { textureIDs[i], texture->x, texture->y, texture->width, texture->height, texture->layer,
+			texture->trimX, texture->trimY, texture->sourceWidth, texture->sourceHeight, texture->u0, texture->v0, texture->u1, texture->v1, 0 };
+		entries.push_back(entry);
+	}
+	std::sort(entries.begin(), entries.end(), isLowerID);
+
+	const size_t tableEnd = sizeof(AtlasFileHeader) + entries.size() * sizeof(AtlasFileEntry);
+	AtlasFileHeader header = { kAtlasFileMagic, kAtlasFileVersion, atlas.pageWidth(), atlas.pageHeight(), (uint32_t)atlas.pageCount(),
+		(uint32_t)entries.size(), (tableEnd + 15) / 16 * 16 };
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		return false;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	if (written && !entries.empty())
+	{
+		written = fwrite(&entries[0], sizeof(AtlasFileEntry), entries.size(), file) == entries.size();
+	}
+	const char padding[16] = { 0 };
+	if (written && header.pagesOffset > tableEnd)
+	{
+		written = fwrite(padding, header.pagesOffset - tableEnd, 1, file) == 1;
+	}
+
+	// A page with nothing blitted yet has no storage; it is written as zeroes.
+	const std::vector<uint32_t> blank(header.pageWidth, 0);
+	for (unsigned int page = 0; written && page < header.pageCount; ++page)
+	{
+		for (unsigned int y = 0; written && y < header.pageHeight; ++y)
+		{
+			const uint32_t* row = page < pixels->pageCount() ? pixels->row(page, y) : &blank[0];
+			written = fwrite(row, sizeof(uint32_t), header.pageWidth, file) == header.pageWidth;
+		}
+	}
+
+	return fclose(file) == 0 && written;
+}
+
+bool AtlasFile::open (const char* path)
+{
+	close();
+
+	const int descriptor = ::open(path, O_RDONLY);
+	if (descriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat status;
+	void* data = MAP_FAILED;
+	if (fstat(descriptor, &status) == 0 && (size_t)status.st_size >= sizeof(AtlasFileHeader))
+	{
+		data = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	}
+	::close(descriptor);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	m_data = static_cast<const uint8_t*>(data);
+	m_size = (size_t)status.st_size;
+	if (!isValid())
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+// The page bytes are checked by dividing what the file holds by each factor in turn, so a
+// hostile header cannot overflow the product.
+bool AtlasFile::isValid() const
+{
+	const AtlasFileHeader& fileHeader = header();
+	const uint64_t tableEnd = sizeof(AtlasFileHeader) + (uint64_t)fileHeader.textureCount * sizeof(AtlasFileEntry);
+	if (fileHeader.magic != kAtlasFileMagic || fileHeader.version != kAtlasFileVersion || fileHeader.pagesOffset % 16
+		|| fileHeader.pagesOffset < tableEnd || fileHeader.pagesOffset > m_size || !fileHeader.pageWidth || !fileHeader.pageHeight
+		|| (m_size - fileHeader.pagesOffset) / sizeof(uint32_t) / fileHeader.pageWidth / fileHeader.pageHeight < fileHeader.pageCount)
+	{
+		return false;
+	}
+
+	const AtlasFileEntry* table = entries();
+	for (size_t i = 0; i < fileHeader.textureCount; ++i)
+	{
+		const AtlasFileEntry& entry = table[i];
+		if ((i && table[i - 1].textureID >= entry.textureID) || entry.layer >= fileHeader.pageCount
+			|| entry.width > fileHeader.pageWidth || entry.x > fileHeader.pageWidth - entry.width
+			|| entry.height > fileHeader.pageHeight || entry.y > fileHeader.pageHeight - entry.height)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void AtlasFile::close()
+{
+	if (m_data)
+	{
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+		m_data = NULL;
+		m_size = 0;
+	}
+}
+
+const AtlasFileEntry* AtlasFile::find (const unsigned long textureID) const
+{
+	const AtlasFileEntry* table = entries();
+	size_t low = 0;
+	size_t high = header().textureCount;
+	while (low < high)
+	{
+		const size_t middle = low + (high - low) / 2;
+		if (table[middle].textureID < textureID)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return low < header().textureCount && table[low].textureID == textureID ? &table[low] : NULL;
+}
+
+#endif
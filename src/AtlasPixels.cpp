@@ -0,0 +1,206 @@
+#ifndef ATLAS_PIXELS_CPP
+#define ATLAS_PIXELS_CPP
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// CPU copy of an atlas's RGBA8 pages, one uint32_t per pixel, rows tightly packed. Images are
+// blitted in row by row and their edges extruded into the gutter around them, so filtering
+// and mip sampling near an edge read the texture's own border instead of a neighbour.
+class AtlasPixels {
+public:
+	inline AtlasPixels(const unsigned int width, const unsigned int height) : m_width(width), m_height(height) {};
+
+	void blit (const unsigned int page, const unsigned int x, const unsigned int y, const unsigned int width, const unsigned int height, const uint32_t* source, const size_t sourceStride);
+	void extrude (const unsigned int page, const unsigned int x, const unsigned int y, const unsigned int width, const unsigned int height, const unsigned int gutter);
+	void copy (const AtlasPixels& source, const unsigned int sourcePage, const unsigned int sourceX, const unsigned int sourceY, const unsigned int width, const unsigned int height, const unsigned int page, const unsigned int x, const unsigned int y);
+	void ensurePages (const size_t pages);
+
+	inline size_t pageCount() const { return m_pages.size(); };
+	inline unsigned int width() const { return m_width; };
+	inline unsigned int height() const { return m_height; };
+	inline const uint32_t* row (const unsigned int page, const unsigned int y) const { return &m_pages[page][(size_t)y * m_width]; };
+	inline uint32_t pixel (const unsigned int page, const unsigned int x, const unsigned int y) const { return m_pages[page][(size_t)y * m_width + x]; };
+
+	static void copyRow (uint32_t* destination, const uint32_t* source, const size_t count);
+	static bool opaqueBounds (const uint32_t* image, const unsigned int width, const unsigned int height, unsigned int& x, unsigned int& y, unsigned int& boundsWidth, unsigned int& boundsHeight);
+	static bool isTransparentRow (const uint32_t* row, const unsigned int width);
+
+	static const uint32_t kAlphaMask = 0xff000000u;
+
+private:
+	const unsigned int m_width;
+	const unsigned int m_height;
+	std::vector<std::vector<uint32_t> > m_pages;
+
+	inline uint32_t* rowFor (const unsigned int page, const unsigned int y) { return &m_pages[page][(size_t)y * m_width]; };
+};
+
+// sourceStride is in pixels. Pages are allocated (cleared to zero) on first use.
+void AtlasPixels::blit (const unsigned int page, const unsigned int x, const unsigned int y, const unsigned int width, const unsigned int height, const uint32_t* source, const size_t sourceStride)
+{
+	ensurePages(page + 1);
+	for (unsigned int row = 0; row < height; ++row)
+	{
+		copyRow(rowFor(page, y + row) + x, source + row * sourceStride, width);
+	}
+}
+
+// Replicates the rect's outermost pixels outwards across the gutter, corners included. The
+// gutter must lie inside the page, which is how PackedAtlas pads its allocations.
+void AtlasPixels::extrude (const unsigned int page, const unsigned int x, const unsigned int y, const unsigned int width, const unsigned int height, const unsigned int gutter)
+{
+	if (!gutter || !width || !height)
+	{
+		return;
+	}
+
+	ensurePages(page + 1);
+	for (unsigned int row = y; row < y + height; ++row)
+	{
+		uint32_t* line = rowFor(page, row);
+		for (unsigned int i = 1; i <= gutter; ++i)
+		{
+			line[x - i] = line[x];
+			line[x + width - 1 + i] = line[x + width - 1];
+		}
+	}
+
+	const size_t span = width + 2 * gutter;
+	for (unsigned int i = 1; i <= gutter; ++i)
+	{
+		copyRow(rowFor(page, y - i) + x - gutter, rowFor(page, y) + x - gutter, span);
+		copyRow(rowFor(page, y + height - 1 + i) + x - gutter, rowFor(page, y + height - 1) + x - gutter, span);
+	}
+}
+
+// Copies a rect out of another store of the same page size, e.g. when a repack moves it.
+void AtlasPixels::copy (const AtlasPixels& source, const unsigned int sourcePage, const unsigned int sourceX, const unsigned int sourceY, const unsigned int width, const unsigned int height, const unsigned int page, const unsigned int x, const unsigned int y)
+{
+	if (sourcePage < source.pageCount())
+	{
+		blit(page, x, y, width, height, source.row(sourcePage, sourceY) + sourceX, source.width());
+	}
+}
+
+void AtlasPixels::ensurePages (const size_t pages)
+{
+	while (m_pages.size() < pages)
+	{
+		m_pages.push_back(std::vector<uint32_t>((size_t)m_width * m_height, 0));
+	}
+}
+
+// Smallest rect holding every pixel with non-zero alpha; false if there is none. Alpha is
+// the top byte of each pixel, which is RGBA8 byte order on little-endian machines. Rows are
+// tested four pixels at a time; columns are only scanned until they meet the bounds so far.
+bool AtlasPixels::opaqueBounds (const uint32_t* image, const unsigned int width, const unsigned int height, unsigned int& x, unsigned int& y, unsigned int& boundsWidth, unsigned int& boundsHeight)
+{
+	unsigned int top = 0;
+	while (top < height && isTransparentRow(image + (size_t)top * width, width))
+	{
+		++top;
+	}
+	if (top == height)
+	{
+		return false;
+	}
+
+	unsigned int bottom = height - 1;
+	while (isTransparentRow(image + (size_t)bottom * width, width))
+	{
+		--bottom;
+	}
+
+	unsigned int left = width - 1;
+	unsigned int right = 0;
+	for (unsigned int row = top; row <= bottom; ++row)
+	{
+		const uint32_t* line = image + (size_t)row * width;
+		for (unsigned int column = 0; column < left; ++column)
+		{
+			if (line[column] & kAlphaMask)
+			{
+				left = column;
+				break;
+			}
+		}
+		for (unsigned int column = width - 1; column > right; --column)
+		{
+			if (line[column] & kAlphaMask)
+			{
+				right = column;
+				break;
+			}
+		}
+	}
+	if (right < left)
+	{
+		right = left;
+	}
+
+	x = left;
+	y = top;
+	boundsWidth = right - left + 1;
+	boundsHeight = bottom - top + 1;
+	return true;
+}
+
+bool AtlasPixels::isTransparentRow (const uint32_t* row, const unsigned int width)
+{
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi32((int)kAlphaMask);
+	__m128i alpha = _mm_setzero_si128();
+	for (; i + 4 <= width; i += 4)
+	{
+		alpha = _mm_or_si128(alpha, _mm_and_si128(_mm_loadu_si128((const __m128i*)(row + i)), mask));
+	}
+	if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())) != 0xffff)
+	{
+		return false;
+	}
+#endif
+
+	for (; i < width; ++i)
+	{
+		if (row[i] & kAlphaMask)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Sixteen bytes (four pixels) per unaligned load and store with SSE2, then a scalar tail.
+// Sprite rows are short, so this is inlined rather than a memcpy call per row.
+void AtlasPixels::copyRow (uint32_t* destination, const uint32_t* source, const size_t count)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i low = _mm_loadu_si128((const __m128i*)(source + i));
+		__m128i high = _mm_loadu_si128((const __m128i*)(source + i + 4));
+		_mm_storeu_si128((__m128i*)(destination + i), low);
+		_mm_storeu_si128((__m128i*)(destination + i + 4), high);
+	}
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm_storeu_si128((__m128i*)(destination + i), _mm_loadu_si128((const __m128i*)(source + i)));
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		destination[i] = source[i];
+	}
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef ATLAS_RECT_CPP
+#define ATLAS_RECT_CPP
+
+// A rectangle of an atlas page, in pixels.
+struct AtlasRect {
+	unsigned int x;
+	unsigned int y;
+	unsigned int width;
+	unsigned int height;
+};
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef ATLAS_REPACKER_CPP
+#define ATLAS_REPACKER_CPP
+
+#include <algorithm>
+#include <vector>
+#include <pthread.h>
+#include <stddef.h>
+#include "PackedAtlas.cpp"
+
+// Defragments a PackedAtlas after add/remove churn. start() snapshots the layout on the
+// render thread and packs it afresh on a worker, tallest textures first, into pages that
+// only the worker touches. poll() never blocks: once the worker is done it adopts the new
+// layout, reconciling textures added or removed meanwhile, and publishes the remap table.
+// Catalogues built after that see the new rects through the same AtlasedTexture pointers.
+class AtlasRepacker {
+public:
+	AtlasRepacker(PackedAtlas& atlas);
+	~AtlasRepacker();
+
+	// False if a job is already running, or if the atlas has no backing or block store to
+	// move the pixels in, as adoptLayout() would refuse the result.
+	bool start();
+	// True on the call that published a new layout; remap() then lists the moved textures.
+	bool poll();
+
+	inline bool running() const { return m_running; };
+	inline const std::vector<AtlasRemap>& remap() const { return m_remap; };
+
+private:
+	PackedAtlas& m_atlas;
+	pthread_t m_thread;
+	pthread_mutex_t m_mutex;
+	bool m_running;
+	bool m_threaded;
+	bool m_done;
+	bool m_packed;
+	RectPacker* m_prototype;
+	size_t m_pageLimit;
+	std::vector<AtlasPlacement> m_placements;
+	std::vector<RectPacker*> m_pages;
+	std::vector<AtlasRemap> m_remap;
+
+	static void* work (void* repacker);
+	void pack();
+	void finish();
+
+	static bool isTaller (const AtlasPlacement& left, const AtlasPlacement& right);
+
+	AtlasRepacker(const AtlasRepacker&);
+	AtlasRepacker& operator=(const AtlasRepacker&);
+};
+
+AtlasRepacker::AtlasRepacker(PackedAtlas& atlas) :
+	m_atlas(atlas),
+	m_running(false),
+	m_threaded(false),
+	m_done(false),
+	m_packed(false),
+	m_prototype(NULL),
+	m_pageLimit(0)
+{
+	pthread_mutex_init(&m_mutex, NULL);
+}
+
+// A job still running is waited for and its layout discarded.
+AtlasRepacker::~AtlasRepacker()
+{
+	if (m_running)
+	{
+		finish();
+		for (size_t i = 0; i < m_pages.size(); ++i)
+		{
+			delete m_pages[i];
+		}
+	}
+	pthread_mutex_destroy(&m_mutex);
+}
+
+// Runs the packing inline if the worker thread cannot be started.
+bool AtlasRepacker::start()
+{
+	if (m_running || (!m_atlas.backingStore() && !m_atlas.blockStore()))
+	{
+		return false;
+	}
+
+	m_atlas.layout(m_placements);
+	m_prototype = m_atlas.createEmptyPage();
+	m_pageLimit = m_atlas.pageLimit();
+	m_pages.clear();
+	m_packed = false;
+	m_done = false;
+	m_running = true;
+
+	m_threaded = pthread_create(&m_thread, NULL, work, this) == 0;
+	if (!m_threaded)
+	{
+		pack();
+		m_done = true;
+	}
+	return true;
+}
+
+bool AtlasRepacker::poll()
+{
+	if (!m_running)
+	{
+		return false;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	const bool done = m_done;
+	pthread_mutex_unlock(&m_mutex);
+	if (!done)
+	{
+		return false;
+	}
+
+	finish();
+	if (!m_packed)
+	{
+		for (size_t i = 0; i < m_pages.size(); ++i)
+		{
+			delete m_pages[i];
+		}
+		m_pages.clear();
+		m_remap.clear();
+		return false;
+	}
+
+	return m_atlas.adoptLayout(m_pages, m_placements, m_remap);
+}
+
+void* AtlasRepacker::work (void* repacker)
+{
+	AtlasRepacker* self = static_cast<AtlasRepacker*>(repacker);
+	self->pack();
+
+	pthread_mutex_lock(&self->m_mutex);
+	self->m_done = true;
+	pthread_mutex_unlock(&self->m_mutex);
+	return NULL;
+}
+
+// Worker side: touches only the snapshot, the prototype and the new pages.
+void AtlasRepacker::pack()
+{
+	std::stable_sort(m_placements.begin(), m_placements.end(), isTaller);
+
+	m_pages.push_back(m_prototype);
+	m_packed = true;
+	for (size_t i = 0; i < m_placements.size() && m_packed; ++i)
+	{
+		AtlasPlacement& placement = m_placements[i];
+		const unsigned int width = placement.rect.width;
+		const unsigned int height = placement.rect.height;
+
+		size_t page = 0;
+		while (page < m_pages.size() && !m_pages[page]->insert(width, height, placement.rect))
+		{
+			++page;
+		}
+		if (page == m_pages.size())
+		{
+			if (m_pages.size() >= m_pageLimit)
+			{
+				m_packed = false;
+				break;
+			}
+			m_pages.push_back(m_prototype->createPage());
+			m_packed = m_pages.back()->insert(width, height, placement.rect);
+		}
+		placement.page = (unsigned int)page;
+	}
+}
+
+void AtlasRepacker::finish()
+{
+	if (m_threaded)
+	{
+		pthread_join(m_thread, NULL);
+	}
+	m_running = false;
+	m_threaded = false;
+	m_prototype = NULL;
+}
+
+bool AtlasRepacker::isTaller (const AtlasPlacement& left, const AtlasPlacement& right)
+{
+	if (left.rect.height != right.rect.height)
+	{
+		return left.rect.height > right.rect.height;
+	}
+	return left.rect.width > right.rect.width;
+}
+
+#endif
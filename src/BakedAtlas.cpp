@@ -0,0 +1,105 @@
+#ifndef BAKED_ATLAS_CPP
+#define BAKED_ATLAS_CPP
+
+#include <vector>
+#include <stddef.h>
+#include "AtlasFile.cpp"
+#include "DirtyRects.cpp"
+
+// TextureManager::Atlas serving the placements of a baked atlas file, so startup does no
+// packing: every texture in the file is already placed, and anything else does not fit.
+// Nothing here falls back to another atlas; an unbaked texture's catalogue rejects it, and
+// BatchCatalogueRegistry opens a new catalogue, with whatever atlas its createCatalogue
+// gives, for it. The AtlasedTextures are built from the table in one pass; the
+// pages stay in the mapping until upload() hands them over. The file must stay open; a file
+// that is not open serves nothing.
+class BakedAtlas : public TextureManager::Atlas {
+public:
+	BakedAtlas(const AtlasFile& file);
+
+	bool willFit (const unsigned long textureID);
+	const AtlasedTexture* addTexture (const unsigned long textureID);
+	const AtlasedTexture* find (const unsigned long textureID) const;
+
+	inline size_t textureCount() const { return m_textures.size(); };
+	inline size_t pageCount() const { return m_file.isOpen() ? m_file.header().pageCount : 0; };
+
+	// One call per page, each the whole page straight out of the mapping.
+	size_t upload (AtlasUploader& uploader) const;
+
+private:
+	const AtlasFile& m_file;
+	std::vector<AtlasedTexture> m_textures;
+
+	BakedAtlas(const BakedAtlas&);
+	BakedAtlas& operator=(const BakedAtlas&);
+};
+
+// m_textures is in table order, so an entry's index is its texture's index.
+BakedAtlas::BakedAtlas(const AtlasFile& file) :
+	m_file(file)
+{
+	if (!m_file.isOpen())
+	{
+		return;
+	}
+
+	const AtlasFileEntry* entries = m_file.entries();
+	m_textures.resize(m_file.header().textureCount);
+	for (size_t i = 0; i < m_textures.size(); ++i)
+	{
+		AtlasedTexture& texture = m_textures[i];
+		texture.x = entries[i].x;
+		texture.y = entries[i].y;
+		texture.width = entries[i].width;
+		texture.height = entries[i].height;
+		texture.layer = entries[i].layer;
+		texture.trimX = entries[i].trimX;
+		texture.trimY = entries[i].trimY;
+		texture.sourceWidth = entries[i].sourceWidth;
+		texture.sourceHeight = entries[i].sourceHeight;
+		texture.u0 = entries[i].u0;
+		texture.v0 = entries[i].v0;
+		texture.u1 = entries[i].u1;
+		texture.v1 = entries[i].v1;
+	}
+}
+
+bool BakedAtlas::willFit (const unsigned long textureID)
+{
+	return find(textureID) != NULL;
+}
+
+const AtlasedTexture* BakedAtlas::addTexture (const unsigned long textureID)
+{
+	return find(textureID);
+}
+
+const AtlasedTexture* BakedAtlas::find (const unsigned long textureID) const
+{
+	if (!m_file.isOpen())
+	{
+		return NULL;
+	}
+
+	const AtlasFileEntry* entry = m_file.find(textureID);
+	return entry ? &m_textures[entry - m_file.entries()] : NULL;
+}
+
+size_t BakedAtlas::upload (AtlasUploader& uploader) const
+{
+	if (!m_file.isOpen())
+	{
+		return 0;
+	}
+
+	const AtlasFileHeader& header = m_file.header();
+	for (unsigned int page = 0; page < header.pageCount; ++page)
+	{
+		const AtlasRect rect = { 0, 0, header.pageWidth, header.pageHeight };
+		uploader.upload(page, rect, m_file.page(page), header.pageWidth);
+	}
+	return header.pageCount;
+}
+
+#endif
@@ -1,6 +1,15 @@
-#include <vector>
+#ifndef BATCH_CATALOGUE_CPP
+#define BATCH_CATALOGUE_CPP
+
 #include <algorithm>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
 #include "min_deps.cpp"
+#include "BatchKey.cpp"
+#include "BatchKeyArray.cpp"
+#include "TextureIdSet.cpp"
+#include "CooccurrenceRecorder.cpp"
 
 class BatchCatalogue {
 public:
@@ -9,17 +18,33 @@ public:
 		m_static(isStatic),
 		m_vShader(vShader),
 		m_fShader(fShader),
-		m_indicies(indicies)
+		m_indicies(indicies),
+		m_key(format, isStatic, vShader, fShader, indicies),
+		m_recorder(NULL)
 	{
 		m_textureAtlas[0] = NULL;
 		m_textureAtlas[1] = NULL;
 		m_textureAtlas[2] = NULL;
 		m_textureAtlas[3] = NULL;
 	};
+	virtual ~BatchCatalogue();
 	bool isMatch (const BatchableObject* object, const bool checkOnly);
+	bool isMatch (const BatchDescriptor& descriptor, const bool checkOnly);
+	size_t matchBatch (const BatchableObject* const* objects, const size_t count, uint8_t* results, const bool checkOnly);
+	size_t matchBatch (const BatchDescriptor* descriptors, const size_t count, uint8_t* results, const bool checkOnly);
 	bool isEligible (const BatchableObject* object);
+	bool isEligible (const BatchDescriptor& descriptor) const;
+	bool isEligible (const BatchKey& key) const;
+	size_t filterEligible (const BatchKeyArray& keys, uint64_t* mask) const;
 	bool willFit (const BatchableObject* object);
+	bool willFit (const BatchDescriptor& descriptor);
 	void addToCatalogue (const BatchableObject* object);
+	void addToCatalogue (const BatchDescriptor& descriptor);
+	bool place (const BatchDescriptor& descriptor);
+	inline const BatchKey& getKey() const { return m_key; };
+	// Every object placed through isMatch, matchBatch or place is reported to the recorder;
+	// objects the catalogue turns down are not.
+	inline void setRecorder (CooccurrenceRecorder* recorder) { m_recorder = recorder; };
 
 protected:
 	const unsigned long m_format;
@@ -27,88 +52,335 @@ protected:
 	const ShaderObject* m_vShader;
 	const ShaderObject* m_fShader;
 	const bool m_indicies;
-	std::vector<unsigned int> m_texturesAlreadyInCatalogue;
+	const BatchKey m_key;
+	TextureIdSet m_texturesAlreadyInCatalogue;
 	TextureManager::Atlas* m_textureAtlas[4];
+	std::vector<unsigned int> m_retainedTextures[4];
+	CooccurrenceRecorder* m_recorder;
 
-	void addToTextureUnit(TextureManager::Atlas* textureUnit, unsigned int textureId);
+	bool reserveTextureUnits(const BatchDescriptor& descriptor, bool reserved[4]);
+	bool commitTextureUnits(const BatchDescriptor& descriptor, bool reserved[4]);
+	void rollbackTextureUnits(const BatchDescriptor& descriptor, bool reserved[4]);
+	void uncommitTextureUnits(const BatchDescriptor& descriptor, const bool committed[4]);
+	void addToTextureUnits(const BatchDescriptor& descriptor);
+	void addToTextureUnit(const int unit, unsigned int textureId);
+	void retainTexture(const int unit, unsigned int textureId);
 	bool catalogueContainsTexture(unsigned int textureId);
+
+	static const unsigned long kTextureUnitFlags[4];
+};
+
+const unsigned long BatchCatalogue::kTextureUnitFlags[4] = {
+	BufferedBatch::kFormatUsesTextureUnit0,
+	BufferedBatch::kFormatUsesTextureUnit1,
+	BufferedBatch::kFormatUsesTextureUnit2,
+	BufferedBatch::kFormatUsesTextureUnit3
 };
 
+// Releases every texture this catalogue retained, in every atlas it placed one in.
+BatchCatalogue::~BatchCatalogue() {
+	for (int unit = 0; unit < 4; ++unit)
+	{
+		for (size_t i = 0; i < m_retainedTextures[unit].size(); ++i)
+		{
+			m_textureAtlas[unit]->release(m_retainedTextures[unit][i]);
+		}
+	}
+}
+
 bool BatchCatalogue::isMatch (const BatchableObject* object, const bool checkOnly) {
-	if (!isEligible(object)) {
+	if (checkOnly) {
+		return isEligible(object);
+	}
+
+	BatchDescriptor descriptor;
+	object->describe(descriptor);
+	return isMatch(descriptor, checkOnly);
+}
+
+bool BatchCatalogue::isMatch (const BatchDescriptor& descriptor, const bool checkOnly) {
+	if (!isEligible(descriptor)) {
 		return false;
 	}
 	if (checkOnly) {
 		return true;
 	}
-	if (!willFit(object)) {
-		return false;
+
+	return place(descriptor);
+}
+
+// Classifies a run of objects in one call; results[i] is 1 where object i matched.
+// Returns the number of matches.
+size_t BatchCatalogue::matchBatch (const BatchableObject* const* objects, const size_t count, uint8_t* results, const bool checkOnly) {
+	if (checkOnly) {
+		size_t matched = 0;
+		for (size_t i = 0; i < count; ++i) {
+			results[i] = isEligible(objects[i]) ? 1 : 0;
+			matched += results[i];
+		}
+		return matched;
 	}
 
-	addToCatalogue(object);
-	return true;
+	const size_t kChunk = 64;
+	BatchDescriptor descriptors[kChunk];
+	size_t matched = 0;
+	for (size_t start = 0; start < count; start += kChunk) {
+		const size_t chunk = (count - start < kChunk) ? count - start : kChunk;
+		for (size_t i = 0; i < chunk; ++i) {
+			objects[start + i]->describe(descriptors[i]);
+		}
+		matched += matchBatch(descriptors, chunk, results + start, checkOnly);
+	}
+	return matched;
 }
 
+// Shaders are compared by pointer against the catalogue's own, which lets the run reuse
+// the catalogue's program id instead of interning every descriptor's shader pair.
+size_t BatchCatalogue::matchBatch (const BatchDescriptor* descriptors, const size_t count, uint8_t* results, const bool checkOnly) {
+	const unsigned short programId = m_key.programId();
+	size_t matched = 0;
+	for (size_t i = 0; i < count; ++i) {
+		const BatchDescriptor& descriptor = descriptors[i];
+		bool match = m_key.isBatchable() && descriptor.vShader == m_vShader && descriptor.fShader == m_fShader &&
+			BatchKey(descriptor.format, descriptor.isStatic, programId, descriptor.indicies) == m_key;
+		if (match && !checkOnly) {
+			match = place(descriptor);
+		}
+		results[i] = match ? 1 : 0;
+		matched += results[i];
+	}
+	return matched;
+}
+
+// Like matchBatch, compares against the catalogue's own shaders and program id, so a check
+// neither touches the shared program table nor makes the remaining calls after a mismatch.
 bool BatchCatalogue::isEligible (const BatchableObject* object) 
 {
-	if (m_format != object->getDataFormat()) { return false; }
-	if (m_static != object->isStatic()) { return false; }
-	if (m_vShader != object->getVertexShader()) { return false; } 
-	if (m_fShader != object->getFragmentShader()) { return false; }
-	if (m_indicies != object->hasIndicies()) { return false; }
-	
+	return m_key.isBatchable() && object->getVertexShader() == m_vShader && object->getFragmentShader() == m_fShader &&
+		BatchKey(object->getDataFormat(), object->isStatic(), m_key.programId(), object->hasIndicies()) == m_key;
+}
+
+bool BatchCatalogue::isEligible (const BatchDescriptor& descriptor) const
+{
+	return m_key.isBatchable() && descriptor.vShader == m_vShader && descriptor.fShader == m_fShader &&
+		BatchKey(descriptor.format, descriptor.isStatic, m_key.programId(), descriptor.indicies) == m_key;
+}
+
+bool BatchCatalogue::isEligible (const BatchKey& key) const
+{
+	return m_key.isBatchable() && m_key == key;
+}
+
+// willFit and addToCatalogue with a single texture probe, for callers that already know
+// the descriptor is eligible.
+bool BatchCatalogue::place (const BatchDescriptor& descriptor)
+{
+	bool alreadyInCatalogue;
+	size_t slot = m_texturesAlreadyInCatalogue.lookup(descriptor.textureIds[0], alreadyInCatalogue);
+	if (!alreadyInCatalogue) {
+		bool reserved[4];
+		if (!reserveTextureUnits(descriptor, reserved)) {
+			return false;
+		}
+
+		if (!commitTextureUnits(descriptor, reserved)) {
+			return false;
+		}
+		m_texturesAlreadyInCatalogue.insertAt(slot, descriptor.textureIds[0]);
+	}
+
+	// Only objects that were placed are reported.
+	if (m_recorder) {
+		m_recorder->record(m_key.value(), descriptor.textureIds[0]);
+	}
 	return true;
 }
 
+// Pre-filter for large scenes: sets bit i of mask when keys[i] is eligible for this catalogue.
+size_t BatchCatalogue::filterEligible (const BatchKeyArray& keys, uint64_t* mask) const
+{
+	if (!m_key.isBatchable())
+	{
+		for (size_t i = 0; i < keys.maskWords(); ++i)
+		{
+			mask[i] = 0;
+		}
+		return 0;
+	}
+	return keys.matching(m_key, mask);
+}
+
 bool BatchCatalogue::willFit (const BatchableObject* object)
 {
-	if (catalogueContainsTexture(object->getPrimaryTextureID()))
+	BatchDescriptor descriptor;
+	object->describe(descriptor);
+	return willFit(descriptor);
+}
+
+bool BatchCatalogue::willFit (const BatchDescriptor& descriptor)
+{
+	if (catalogueContainsTexture(descriptor.textureIds[0]))
 	{
 		return true;
 	}
-	if (m_textureAtlas[0]) 
+
+	bool reserved[4];
+	if (!reserveTextureUnits(descriptor, reserved))
 	{
-		return m_textureAtlas[0]->willFit(object->getPrimaryTextureID());
+		return false;
 	}
 
+	rollbackTextureUnits(descriptor, reserved);
 	return true;
 }
 
 bool BatchCatalogue::catalogueContainsTexture(unsigned int textureId)
 {
-	return std::find(m_texturesAlreadyInCatalogue.begin(), m_texturesAlreadyInCatalogue.end(), textureId) != m_texturesAlreadyInCatalogue.end();
+	return m_texturesAlreadyInCatalogue.contains(textureId);
 }
 
 void BatchCatalogue::addToCatalogue (const BatchableObject* object) {
-	if (catalogueContainsTexture(object->getPrimaryTextureID()))
+	BatchDescriptor descriptor;
+	object->describe(descriptor);
+	addToCatalogue(descriptor);
+}
+
+void BatchCatalogue::addToCatalogue (const BatchDescriptor& descriptor) {
+	bool alreadyInCatalogue;
+	size_t slot = m_texturesAlreadyInCatalogue.lookup(descriptor.textureIds[0], alreadyInCatalogue);
+	if (alreadyInCatalogue)
 	{
 		return;
 	}
 
-	if (object->getDataFormat() & BufferedBatch::kFormatUsesTextureUnit0) 
+	addToTextureUnits(descriptor);
+	m_texturesAlreadyInCatalogue.insertAt(slot, descriptor.textureIds[0]);
+}
+
+// Reserves space in every atlas the object needs before committing any of them, so a
+// catalogue never accepts an object it cannot fully place. Unit 0 is fit-checked even when
+// the format does not use it, as it always has been.
+bool BatchCatalogue::reserveTextureUnits (const BatchDescriptor& descriptor, bool reserved[4]) {
+	for (int unit = 0; unit < 4; ++unit)
 	{
-		addToTextureUnit(m_textureAtlas[0], object->getTextureID(0));
+		reserved[unit] = false;
 	}
-	if (object->getDataFormat() & BufferedBatch::kFormatUsesTextureUnit1) 
+
+	for (int unit = 0; unit < 4; ++unit)
 	{
-		addToTextureUnit(m_textureAtlas[1], object->getTextureID(1));
+		TextureManager::Atlas* textureUnit = m_textureAtlas[unit];
+		if (!textureUnit)
+		{
+			continue;
+		}
+
+		bool fits;
+		if (descriptor.format & kTextureUnitFlags[unit])
+		{
+			fits = reserved[unit] = textureUnit->reserve(descriptor.textureIds[unit]);
+		}
+		else
+		{
+			fits = unit != 0 || textureUnit->willFit(descriptor.textureIds[unit]);
+		}
+
+		if (!fits)
+		{
+			rollbackTextureUnits(descriptor, reserved);
+			return false;
+		}
 	}
-	if (object->getDataFormat() & BufferedBatch::kFormatUsesTextureUnit2) 
+
+	return true;
+}
+
+// All or nothing: a commit that returns NULL fails the placement, the units not committed
+// yet are rolled back and the ones committed by this call are released and removed again.
+// Removal leaves a texture this catalogue placed before, and atlases that count references
+// (LruAtlas) keep one another catalogue still retains.
+bool BatchCatalogue::commitTextureUnits (const BatchDescriptor& descriptor, bool reserved[4]) {
+	bool committed[4] = { false, false, false, false };
+	for (int unit = 0; unit < 4; ++unit)
 	{
-		addToTextureUnit(m_textureAtlas[2], object->getTextureID(2));
+		if (!reserved[unit])
+		{
+			continue;
+		}
+
+		reserved[unit] = false;
+		if (!m_textureAtlas[unit]->commit(descriptor.textureIds[unit]))
+		{
+			rollbackTextureUnits(descriptor, reserved);
+			uncommitTextureUnits(descriptor, committed);
+			return false;
+		}
+		retainTexture(unit, descriptor.textureIds[unit]);
+		committed[unit] = true;
 	}
-	if (object->getDataFormat() & BufferedBatch::kFormatUsesTextureUnit3) 
+	return true;
+}
+
+void BatchCatalogue::uncommitTextureUnits (const BatchDescriptor& descriptor, const bool committed[4]) {
+	for (int unit = 3; unit >= 0; --unit)
+	{
+		if (!committed[unit])
+		{
+			continue;
+		}
+
+		const unsigned int textureId = descriptor.textureIds[unit];
+		std::vector<unsigned int>& retained = m_retainedTextures[unit];
+		retained.pop_back();
+		m_textureAtlas[unit]->release(textureId);
+		if (std::find(retained.begin(), retained.end(), textureId) == retained.end())
+		{
+			m_textureAtlas[unit]->removeTexture(textureId);
+		}
+	}
+}
+
+void BatchCatalogue::rollbackTextureUnits (const BatchDescriptor& descriptor, bool reserved[4]) {
+	for (int unit = 3; unit >= 0; --unit)
 	{
-		addToTextureUnit(m_textureAtlas[3], object->getTextureID(3));
+		if (reserved[unit])
+		{
+			m_textureAtlas[unit]->rollback(descriptor.textureIds[unit]);
+			reserved[unit] = false;
+		}
 	}
+}
 
-	m_texturesAlreadyInCatalogue.push_back(object->getPrimaryTextureID());
+void BatchCatalogue::addToTextureUnits (const BatchDescriptor& descriptor) {
+	if (descriptor.format & BufferedBatch::kFormatUsesTextureUnit0) 
+	{
+		addToTextureUnit(0, descriptor.textureIds[0]);
+	}
+	if (descriptor.format & BufferedBatch::kFormatUsesTextureUnit1) 
+	{
+		addToTextureUnit(1, descriptor.textureIds[1]);
+	}
+	if (descriptor.format & BufferedBatch::kFormatUsesTextureUnit2) 
+	{
+		addToTextureUnit(2, descriptor.textureIds[2]);
+	}
+	if (descriptor.format & BufferedBatch::kFormatUsesTextureUnit3) 
+	{
+		addToTextureUnit(3, descriptor.textureIds[3]);
+	}
 }
 
-void BatchCatalogue::addToTextureUnit(TextureManager::Atlas* textureUnit, unsigned int textureId)
+void BatchCatalogue::addToTextureUnit(const int unit, unsigned int textureId)
 {
-	if (textureUnit) 
+	if (m_textureAtlas[unit] && m_textureAtlas[unit]->addTexture(textureId)) 
 	{
-		textureUnit->addTexture(textureId);
+		retainTexture(unit, textureId);
 	}
-}
\ No newline at end of file
+}
+
+void BatchCatalogue::retainTexture(const int unit, unsigned int textureId)
+{
+	m_textureAtlas[unit]->retain(textureId);
+	m_retainedTextures[unit].push_back(textureId);
+}
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef BATCH_CATALOGUE_REGISTRY_CPP
+#define BATCH_CATALOGUE_REGISTRY_CPP
+
+#include <vector>
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include "BatchCatalogue.cpp"
+
+// Owns every catalogue built for a frame and finds the ones an object is eligible for
+// through an open-addressing (linear probe) table keyed on BatchKey. Catalogues sharing
+// a key are kept in creation order, so the first one with room wins as with a full scan.
+class BatchCatalogueRegistry {
+public:
+	BatchCatalogueRegistry();
+	virtual ~BatchCatalogueRegistry();
+
+	BatchCatalogue* catalogueFor (const BatchableObject* object);
+	BatchCatalogue* catalogueFor (const BatchDescriptor& descriptor);
+	BatchCatalogue* catalogueFor (const BatchDescriptor& descriptor, const BatchKey& key);
+	BatchCatalogue* openCatalogue (const BatchDescriptor& descriptor, const BatchKey& key);
+	void clear();
+	void sortByProgram();
+	// Handed to every catalogue the registry holds or creates from now on.
+	void setRecorder (CooccurrenceRecorder* recorder);
+
+	inline size_t size() const { return m_catalogues.size(); };
+	inline BatchCatalogue* at(const size_t index) const { return m_catalogues[index]; };
+
+protected:
+	// Override to hand out catalogues wired to the engine's texture atlases.
+	virtual BatchCatalogue* createCatalogue (const BatchDescriptor& descriptor);
+
+private:
+	struct Slot {
+		uint64_t key;
+		int bucket;
+	};
+
+	std::vector<Slot> m_slots;
+	std::vector<std::vector<BatchCatalogue*> > m_buckets;
+	std::vector<BatchCatalogue*> m_catalogues;
+	CooccurrenceRecorder* m_recorder;
+
+	std::vector<BatchCatalogue*>& bucketFor(const BatchKey& key);
+	void grow();
+
+	static size_t hash(const uint64_t key);
+	static bool programIsLess(const BatchCatalogue* left, const BatchCatalogue* right);
+	static const size_t kInitialSlots = 64;
+
+	BatchCatalogueRegistry(const BatchCatalogueRegistry&);
+	BatchCatalogueRegistry& operator=(const BatchCatalogueRegistry&);
+};
+
+BatchCatalogueRegistry::BatchCatalogueRegistry() :
+	m_recorder(NULL)
+{
+	Slot empty = { 0, -1 };
+	m_slots.assign(kInitialSlots, empty);
+}
+
+BatchCatalogueRegistry::~BatchCatalogueRegistry()
+{
+	clear();
+}
+
+void BatchCatalogueRegistry::clear()
+{
+	for (size_t i = 0; i < m_catalogues.size(); ++i)
+	{
+		delete m_catalogues[i];
+	}
+	m_catalogues.clear();
+	m_buckets.clear();
+
+	Slot empty = { 0, -1 };
+	m_slots.assign(kInitialSlots, empty);
+}
+
+void BatchCatalogueRegistry::setRecorder (CooccurrenceRecorder* recorder)
+{
+	m_recorder = recorder;
+	for (size_t i = 0; i < m_catalogues.size(); ++i)
+	{
+		m_catalogues[i]->setRecorder(recorder);
+	}
+}
+
+// Reorders at() so catalogues sharing a shader program are adjacent for submission.
+void BatchCatalogueRegistry::sortByProgram()
+{
+	std::stable_sort(m_catalogues.begin(), m_catalogues.end(), programIsLess);
+}
+
+bool BatchCatalogueRegistry::programIsLess(const BatchCatalogue* left, const BatchCatalogue* right)
+{
+	return left->getKey().programId() < right->getKey().programId();
+}
+
+BatchCatalogue* BatchCatalogueRegistry::catalogueFor (const BatchableObject* object)
+{
+	BatchDescriptor descriptor;
+	object->describe(descriptor);
+	return catalogueFor(descriptor);
+}
+
+BatchCatalogue* BatchCatalogueRegistry::catalogueFor (const BatchDescriptor& descriptor)
+{
+	// Shader pairs are interned only when a catalogue is opened for them, so one the table
+	// does not know has no bucket yet and goes straight to a new catalogue.
+	const BatchKey key = BatchKey::forDescriptor(descriptor);
+	if (!key.isBatchable())
+	{
+		return openCatalogue(descriptor, BatchKey::forNewCatalogue(descriptor));
+	}
+	return catalogueFor(descriptor, key);
+}
+
+// Returns NULL when the object is unbatchable or a freshly created catalogue cannot take it.
+BatchCatalogue* BatchCatalogueRegistry::catalogueFor (const BatchDescriptor& descriptor, const BatchKey& key)
+{
+	if (!key.isBatchable())
+	{
+		return NULL;
+	}
+
+	std::vector<BatchCatalogue*>& bucket = bucketFor(key);
+	for (size_t i = 0; i < bucket.size(); ++i)
+	{
+		if (bucket[i]->place(descriptor))
+		{
+			return bucket[i];
+		}
+	}
+
+	return openCatalogue(descriptor, key);
+}
+
+// Always starts a new catalogue for key and places the descriptor in it. The catalogue is
+// registered only if that works; one that cannot take its first object is deleted.
+BatchCatalogue* BatchCatalogueRegistry::openCatalogue (const BatchDescriptor& descriptor, const BatchKey& key)
+{
+	if (!key.isBatchable())
+	{
+		return NULL;
+	}
+
+	BatchCatalogue* catalogue = createCatalogue(descriptor);
+	if (m_recorder)
+	{
+		catalogue->setRecorder(m_recorder);
+	}
+	if (!catalogue->place(descriptor))
+	{
+		delete catalogue;
+		return NULL;
+	}
+
+	m_catalogues.push_back(catalogue);
+	bucketFor(key).push_back(catalogue);
+	return catalogue;
+}
+
+BatchCatalogue* BatchCatalogueRegistry::createCatalogue (const BatchDescriptor& descriptor)
+{
+	return new BatchCatalogue(descriptor.format, descriptor.isStatic, descriptor.vShader, descriptor.fShader, descriptor.indicies);
+}
+
+std::vector<BatchCatalogue*>& BatchCatalogueRegistry::bucketFor(const BatchKey& key)
+{
+	const size_t mask = m_slots.size() - 1;
+	size_t index = hash(key.value()) & mask;
+	while (m_slots[index].bucket >= 0)
+	{
+		if (m_slots[index].key == key.value())
+		{
+			return m_buckets[m_slots[index].bucket];
+		}
+		index = (index + 1) & mask;
+	}
+
+	m_slots[index].key = key.value();
+	m_slots[index].bucket = (int)m_buckets.size();
+	m_buckets.push_back(std::vector<BatchCatalogue*>());
+
+	if (m_buckets.size() * 4 > m_slots.size() * 3)
+	{
+		grow();
+	}
+
+	return m_buckets.back();
+}
+
+void BatchCatalogueRegistry::grow()
+{
+	std::vector<Slot> old;
+	old.swap(m_slots);
+
+	Slot empty = { 0, -1 };
+	m_slots.assign(old.size() * 2, empty);
+
+	const size_t mask = m_slots.size() - 1;
+	for (size_t i = 0; i < old.size(); ++i)
+	{
+		if (old[i].bucket < 0)
+		{
+			continue;
+		}
+		size_t index = hash(old[i].key) & mask;
+		while (m_slots[index].bucket >= 0)
+		{
+			index = (index + 1) & mask;
+		}
+		m_slots[index] = old[i];
+	}
+}
+
+// 64-bit finalizer from MurmurHash3; keys differ mostly in a few high bits.
+size_t BatchCatalogueRegistry::hash(const uint64_t key)
+{
+	uint64_t h = key;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (size_t)h;
+}
+
+#endif
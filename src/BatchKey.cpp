@@ -0,0 +1,94 @@
+#ifndef BATCH_KEY_CPP
+#define BATCH_KEY_CPP
+
+#include <stdint.h>
+#include "min_deps.cpp"
+#include "ShaderProgramTable.cpp"
+
+// Packs everything BatchCatalogue::isEligible compares into one 64-bit word:
+//   bits  0-31  data format (the BufferedBatch format flags live in the low bits)
+//   bit   32    static
+//   bit   33    has indicies
+//   bits 48-63  shader program id from ShaderProgramTable
+// The program id sits in the top bits so ordering keys groups catalogues by program.
+// A format with bits past 31 does not fit, nor does a shader pair the program table had no
+// id left for; such objects get kUnbatchable instead: a key no catalogue is eligible for,
+// rather than one that aliases another object's.
+// Only the constructor taking shader pointers and forNewCatalogue intern the shader pair;
+// forObject and forDescriptor just look it up, so a pair no catalogue was opened for is
+// unbatchable to them.
+class BatchKey {
+public:
+	inline BatchKey() : m_key(0) {};
+	inline BatchKey(const unsigned long format, const bool isStatic, const ShaderObject* vShader, const ShaderObject* fShader, const bool indicies) :
+		m_key(pack(format, isStatic, ShaderProgramTable::shared().intern(vShader, fShader), indicies))
+	{};
+	inline BatchKey(const unsigned long format, const bool isStatic, const unsigned short programId, const bool indicies) :
+		m_key(pack(format, isStatic, programId, indicies))
+	{};
+
+	static BatchKey forObject(const BatchableObject* object);
+	static BatchKey forDescriptor(const BatchDescriptor& descriptor);
+	static BatchKey forNewCatalogue(const BatchDescriptor& descriptor);
+	static BatchKey fromValue(const uint64_t value);
+
+	inline bool operator== (const BatchKey& other) const { return m_key == other.m_key; }
+	inline bool operator!= (const BatchKey& other) const { return m_key != other.m_key; }
+	inline bool operator< (const BatchKey& other) const { return m_key < other.m_key; }
+	inline uint64_t value() const { return m_key; }
+	inline unsigned short programId() const { return (unsigned short)(m_key >> 48); }
+	inline bool isBatchable() const { return m_key != kUnbatchable; }
+
+	// Bits 34-47 are never set in a packed key, so this value cannot collide with one.
+	static const uint64_t kUnbatchable = ~0ULL;
+
+private:
+	uint64_t m_key;
+
+	static uint64_t pack(const unsigned long format, const bool isStatic, const unsigned short programId, const bool indicies);
+};
+
+BatchKey BatchKey::forObject(const BatchableObject* object)
+{
+	const unsigned short programId = ShaderProgramTable::shared().find(object->getVertexShader(), object->getFragmentShader());
+	return BatchKey(object->getDataFormat(), object->isStatic(), programId, object->hasIndicies());
+}
+
+BatchKey BatchKey::forDescriptor(const BatchDescriptor& descriptor)
+{
+	return BatchKey(descriptor.format, descriptor.isStatic, ShaderProgramTable::shared().find(descriptor.vShader, descriptor.fShader), descriptor.indicies);
+}
+
+// For callers about to open a catalogue with the key. The format is checked first so an
+// unbatchable descriptor does not take a program id.
+BatchKey BatchKey::forNewCatalogue(const BatchDescriptor& descriptor)
+{
+	if ((descriptor.format >> 16) >> 16)
+	{
+		return fromValue(kUnbatchable);
+	}
+	return BatchKey(descriptor.format, descriptor.isStatic, descriptor.vShader, descriptor.fShader, descriptor.indicies);
+}
+
+BatchKey BatchKey::fromValue(const uint64_t value)
+{
+	BatchKey key;
+	key.m_key = value;
+	return key;
+}
+
+uint64_t BatchKey::pack(const unsigned long format, const bool isStatic, const unsigned short programId, const bool indicies)
+{
+	if ((format >> 16) >> 16 || programId == ShaderProgramTable::kNoProgram)
+	{
+		return kUnbatchable;
+	}
+
+	uint64_t key = (uint64_t)format;
+	key |= (uint64_t)(isStatic ? 1 : 0) << 32;
+	key |= (uint64_t)(indicies ? 1 : 0) << 33;
+	key |= (uint64_t)programId << 48;
+	return key;
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef BATCH_KEY_ARRAY_CPP
+#define BATCH_KEY_ARRAY_CPP
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "BatchKey.cpp"
+
+// Packed object keys for a frame, stored contiguously so one catalogue key can be compared
+// against all of them at once. matching() writes one bit per key, 64 keys per mask word:
+// AVX2 compares four keys per instruction, SSE2 two, otherwise a scalar loop.
+class BatchKeyArray {
+public:
+	inline BatchKeyArray() {};
+
+	inline void push_back (const BatchKey& key) { m_keys.push_back(key.value()); };
+	inline void reserve (const size_t count) { m_keys.reserve(count); };
+	inline void clear() { m_keys.clear(); };
+	inline size_t size() const { return m_keys.size(); };
+	inline size_t maskWords() const { return (m_keys.size() + 63) / 64; };
+	inline const uint64_t* data() const { return m_keys.empty() ? NULL : &m_keys[0]; };
+
+	size_t matching (const BatchKey& key, uint64_t* mask) const;
+
+	static size_t matching (const uint64_t* keys, const size_t count, const uint64_t key, uint64_t* mask);
+
+private:
+	std::vector<uint64_t> m_keys;
+
+	static uint64_t matchWord (const uint64_t* keys, const size_t count, const uint64_t key);
+};
+
+size_t BatchKeyArray::matching (const BatchKey& key, uint64_t* mask) const
+{
+	return matching(data(), m_keys.size(), key.value(), mask);
+}
+
+// mask must hold (count + 63) / 64 words. Returns the number of matching keys.
+size_t BatchKeyArray::matching (const uint64_t* keys, const size_t count, const uint64_t key, uint64_t* mask)
+{
+	size_t matched = 0;
+	for (size_t start = 0; start < count; start += 64)
+	{
+		const size_t run = (count - start < 64) ? count - start : 64;
+		uint64_t word = matchWord(keys + start, run, key);
+		mask[start / 64] = word;
+		matched += __builtin_popcountll(word);
+	}
+	return matched;
+}
+
+uint64_t BatchKeyArray::matchWord (const uint64_t* keys, const size_t count, const uint64_t key)
+{
+	uint64_t word = 0;
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	const __m256i needle = _mm256_set1_epi64x((long long)key);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(keys + i)), needle);
+		word |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+	}
+#elif defined(__SSE2__)
+	// SSE2 has no 64-bit compare: both 32-bit halves have to match.
+	const __m128i needle = _mm_set1_epi64x((long long)key);
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(keys + i)), needle);
+		eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+		word |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		word |= (uint64_t)(keys[i] == key) << i;
+	}
+
+	return word;
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef CONTENT_HASH_CPP
+#define CONTENT_HASH_CPP
+
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 64-bit hash of an image payload, eight bytes per step (MurmurHash64A). Not cryptographic:
+// two different images collide with odds of about 2^-64 per pair.
+uint64_t contentHash (const void* data, const size_t bytes, const uint64_t seed)
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+
+	const unsigned char* bytesIn = static_cast<const unsigned char*>(data);
+	uint64_t h = seed ^ (bytes * m);
+
+	const size_t words = bytes / 8;
+	for (size_t i = 0; i < words; ++i)
+	{
+		uint64_t k;
+		memcpy(&k, bytesIn + i * 8, 8);
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+
+	const unsigned char* tail = bytesIn + words * 8;
+	const size_t remaining = bytes & 7;
+	if (remaining)
+	{
+		for (size_t i = remaining; i > 0; --i)
+		{
+			h ^= (uint64_t)tail[i - 1] << (8 * (i - 1));
+		}
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+#endif
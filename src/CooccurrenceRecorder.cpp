@@ -0,0 +1,147 @@
+#ifndef COOCCURRENCE_RECORDER_CPP
+#define COOCCURRENCE_RECORDER_CPP
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Counts, over real frames, how often two primary textures are drawn in the same frame by
+// objects of the same batch key. Those are the textures a catalogue wants on one atlas page:
+// when they are split, the catalogue for that key fills up and the frame needs another
+// batch. Catalogues given a recorder report every object they place; at the end of the frame
+// each key's distinct textures add one to every pair among them. Keys drawing more than
+// maxGroup textures count only their first maxGroup, bounding the per-frame cost.
+// Not thread-safe: record from the thread that places objects.
+class CooccurrenceRecorder {
+public:
+	typedef std::pair<unsigned long, unsigned long> TexturePair;
+
+	inline CooccurrenceRecorder(const size_t maxGroup = 256) : m_maxGroup(maxGroup), m_frames(0) {};
+
+	void record (const uint64_t batchKey, const unsigned long textureID);
+	void endFrame();
+	void clear();
+
+	inline unsigned long long frames() const { return m_frames; };
+	// Pairs are stored with the lower id first.
+	inline const std::map<TexturePair, unsigned long long>& pairs() const { return m_pairs; };
+	inline const std::map<unsigned long, unsigned long long>& textures() const { return m_textureFrames; };
+	unsigned long long pairCount (const unsigned long first, const unsigned long second) const;
+
+	// Text statistics for the offline grouping tool; load() adds to what is recorded.
+	bool save (const char* path) const;
+	bool load (const char* path);
+
+private:
+	const size_t m_maxGroup;
+	unsigned long long m_frames;
+	std::map<uint64_t, std::vector<unsigned long> > m_frameGroups;
+	std::map<TexturePair, unsigned long long> m_pairs;
+	std::map<unsigned long, unsigned long long> m_textureFrames;
+};
+
+void CooccurrenceRecorder::record (const uint64_t batchKey, const unsigned long textureID)
+{
+	m_frameGroups[batchKey].push_back(textureID);
+}
+
+void CooccurrenceRecorder::endFrame()
+{
+	for (std::map<uint64_t, std::vector<unsigned long> >::iterator group = m_frameGroups.begin(); group != m_frameGroups.end(); ++group)
+	{
+		std::vector<unsigned long>& textures = group->second;
+		std::sort(textures.begin(), textures.end());
+		textures.erase(std::unique(textures.begin(), textures.end()), textures.end());
+		if (textures.size() > m_maxGroup)
+		{
+			textures.resize(m_maxGroup);
+		}
+
+		for (size_t i = 0; i < textures.size(); ++i)
+		{
+			++m_textureFrames[textures[i]];
+			for (size_t j = i + 1; j < textures.size(); ++j)
+			{
+				++m_pairs[TexturePair(textures[i], textures[j])];
+			}
+		}
+	}
+	m_frameGroups.clear();
+	++m_frames;
+}
+
+void CooccurrenceRecorder::clear()
+{
+	m_frames = 0;
+	m_frameGroups.clear();
+	m_pairs.clear();
+	m_textureFrames.clear();
+}
+
+unsigned long long CooccurrenceRecorder::pairCount (const unsigned long first, const unsigned long second) const
+{
+	std::map<TexturePair, unsigned long long>::const_iterator found = m_pairs.find(first < second ? TexturePair(first, second) : TexturePair(second, first));
+	return found == m_pairs.end() ? 0 : found->second;
+}
+
+// One "frames", "t <id> <frames>" or "p <id> <id> <count>" record per line.
+bool CooccurrenceRecorder::save (const char* path) const
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		return false;
+	}
+
+	fprintf(file, "frames %llu\n", m_frames);
+	for (std::map<unsigned long, unsigned long long>::const_iterator texture = m_textureFrames.begin(); texture != m_textureFrames.end(); ++texture)
+	{
+		fprintf(file, "t %lu %llu\n", texture->first, texture->second);
+	}
+	for (std::map<TexturePair, unsigned long long>::const_iterator pair = m_pairs.begin(); pair != m_pairs.end(); ++pair)
+	{
+		fprintf(file, "p %lu %lu %llu\n", pair->first.first, pair->first.second, pair->second);
+	}
+	return fclose(file) == 0;
+}
+
+bool CooccurrenceRecorder::load (const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (!file)
+	{
+		return false;
+	}
+
+	bool valid = true;
+	char kind[8];
+	while (valid && fscanf(file, "%7s", kind) == 1)
+	{
+		unsigned long first, second;
+		unsigned long long count;
+		if (kind[0] == 'f' && fscanf(file, "%llu", &count) == 1)
+		{
+			m_frames += count;
+		}
+		else if (kind[0] == 't' && fscanf(file, "%lu %llu", &first, &count) == 2)
+		{
+			m_textureFrames[first] += count;
+		}
+		else if (kind[0] == 'p' && fscanf(file, "%lu %lu %llu", &first, &second, &count) == 3)
+		{
+			m_pairs[first < second ? TexturePair(first, second) : TexturePair(second, first)] += count;
+		}
+		else
+		{
+			valid = false;
+		}
+	}
+	fclose(file);
+	return valid;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef DIRTY_RECTS_CPP
+#define DIRTY_RECTS_CPP
+
+#include <algorithm>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "AtlasRect.cpp"
+
+struct AtlasDirtyRect {
+	unsigned int page;
+	AtlasRect rect;
+};
+
+// Receives a frame's coalesced page updates; an engine implementation issues one sub-image
+// upload per call. pixels points at the rect's top-left in the backing store with rows
+// stride pixels apart, or is NULL when the atlas keeps no backing store.
+class AtlasUploader {
+public:
+	virtual ~AtlasUploader() {};
+	virtual void upload (const unsigned int page, const AtlasRect& rect, const uint32_t* pixels, const size_t stride) = 0;
+	// Block-compressed pages: blocks points at the rect's first block, rows of blocks stride
+	// bytes apart. Uploaders without compressed support get a plain upload without pixels.
+	virtual void uploadBlocks (const unsigned int page, const AtlasRect& rect, const uint8_t*, const size_t) { upload(page, rect, NULL, 0); };
+};
+
+// Regions of atlas pages written since the last upload. take() merges them into a few larger
+// rects: two rects on a page are merged when the bounding box uploads no more pixels than
+// the pair plus callCost, the price of one upload call expressed in pixels. Uploading the
+// merged set costs a few big copies instead of one small sub-image call per texture.
+// Only neighbours in sorted order are tried, so take() is O(n log n) in the rects written.
+class DirtyRects {
+public:
+	inline DirtyRects(const unsigned long long callCost = kDefaultCallCost) : m_callCost(callCost) {};
+
+	void add (const unsigned int page, const AtlasRect& rect);
+	void take (std::vector<AtlasDirtyRect>& rects);
+	inline void clear() { m_rects.clear(); };
+	inline bool empty() const { return m_rects.empty(); };
+	inline size_t size() const { return m_rects.size(); };
+	inline void setCallCost (const unsigned long long callCost) { m_callCost = callCost; };
+	inline unsigned long long callCost() const { return m_callCost; };
+
+	static const unsigned long long kDefaultCallCost = 4096;
+
+private:
+	std::vector<AtlasDirtyRect> m_rects;
+	unsigned long long m_callCost;
+
+	void sweep();
+
+	static bool isAboveOrLeft (const AtlasDirtyRect& left, const AtlasDirtyRect& right);
+	static bool isLeftOrAbove (const AtlasDirtyRect& left, const AtlasDirtyRect& right);
+	static AtlasRect bounds (const AtlasRect& a, const AtlasRect& b);
+	static inline unsigned long long area (const AtlasRect& rect) { return (unsigned long long)rect.width * rect.height; };
+};
+
+const unsigned long long DirtyRects::kDefaultCallCost;
+
+void DirtyRects::add (const unsigned int page, const AtlasRect& rect)
+{
+	if (!rect.width || !rect.height)
+	{
+		return;
+	}
+
+	const AtlasDirtyRect dirty = { page, rect };
+	m_rects.push_back(dirty);
+}
+
+// Merges along rows, then down columns, then hands the set over and starts empty.
+void DirtyRects::take (std::vector<AtlasDirtyRect>& rects)
+{
+	std::sort(m_rects.begin(), m_rects.end(), isAboveOrLeft);
+	sweep();
+	std::sort(m_rects.begin(), m_rects.end(), isLeftOrAbove);
+	sweep();
+
+	rects.clear();
+	rects.swap(m_rects);
+}
+
+// Each rect merges into the one kept before it when that is worth it.
+void DirtyRects::sweep()
+{
+	if (m_rects.empty())
+	{
+		return;
+	}
+
+	size_t kept = 0;
+	for (size_t i = 1; i < m_rects.size(); ++i)
+	{
+		AtlasDirtyRect& last = m_rects[kept];
+		if (last.page == m_rects[i].page)
+		{
+			const AtlasRect box = bounds(last.rect, m_rects[i].rect);
+			if (area(box) <= area(last.rect) + area(m_rects[i].rect) + m_callCost)
+			{
+				last.rect = box;
+				continue;
+			}
+		}
+		m_rects[++kept] = m_rects[i];
+	}
+	m_rects.resize(kept + 1);
+}
+
+bool DirtyRects::isAboveOrLeft (const AtlasDirtyRect& left, const AtlasDirtyRect& right)
+{
+	if (left.page != right.page)
+	{
+		return left.page < right.page;
+	}
+	if (left.rect.y != right.rect.y)
+	{
+		return left.rect.y < right.rect.y;
+	}
+	return left.rect.x < right.rect.x;
+}
+
+bool DirtyRects::isLeftOrAbove (const AtlasDirtyRect& left, const AtlasDirtyRect& right)
+{
+	if (left.page != right.page)
+	{
+		return left.page < right.page;
+	}
+	if (left.rect.x != right.rect.x)
+	{
+		return left.rect.x < right.rect.x;
+	}
+	return left.rect.y < right.rect.y;
+}
+
+AtlasRect DirtyRects::bounds (const AtlasRect& a, const AtlasRect& b)
+{
+	const unsigned int left = a.x < b.x ? a.x : b.x;
+	const unsigned int top = a.y < b.y ? a.y : b.y;
+	const unsigned int right = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+	const unsigned int bottom = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+	const AtlasRect box = { left, top, right - left, bottom - top };
+	return box;
+}
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef LRU_ATLAS_CPP
+#define LRU_ATLAS_CPP
+
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+#include "min_deps.cpp"
+
+// Wraps an atlas that supports removeTexture and evicts least recently used textures when it
+// runs out of room, so a long session's atlas use stays bounded by the atlas size. Only
+// textures no catalogue retains and that were last used before the current frame are
+// evicted; anything placed or touched this frame may already be in a submitted batch.
+// Eviction happens when placing, oldest first until the texture fits, and only when the
+// wrapped atlas's fitsWithout() says evicting every candidate would make room: a texture
+// that would not fit even then evicts nothing.
+class LruAtlas : public TextureManager::Atlas {
+public:
+	inline LruAtlas(TextureManager::Atlas* atlas) : m_atlas(atlas), m_frame(0), m_evictions(0) {};
+
+	// Call once per frame, with a frame number that never decreases.
+	inline void beginFrame (const unsigned long long frame) { m_frame = frame; };
+	// Marks a texture as drawn this frame without placing it again.
+	void touch (const unsigned long textureID);
+
+	bool willFit (const unsigned long textureID);
+	const AtlasedTexture* addTexture (const unsigned long textureID);
+	bool removeTexture (const unsigned long textureID);
+	bool fitsWithout (const unsigned long textureID, const std::vector<unsigned long>& removed);
+
+	bool reserve (const unsigned long textureID);
+	const AtlasedTexture* commit (const unsigned long textureID);
+	void rollback (const unsigned long textureID);
+
+	void retain (const unsigned long textureID);
+	void release (const unsigned long textureID);
+
+	inline size_t textureCount() const { return m_entries.size(); };
+	inline size_t evictableCount() const { return m_evictable.size(); };
+	inline unsigned long long evictions() const { return m_evictions; };
+	unsigned int references (const unsigned long textureID) const;
+
+private:
+	struct Entry {
+		unsigned int references;
+		unsigned long long lastUsed;
+	};
+
+	typedef std::pair<unsigned long long, unsigned long> Age;
+
+	TextureManager::Atlas* m_atlas;
+	unsigned long long m_frame;
+	unsigned long long m_evictions;
+	std::map<unsigned long, Entry> m_entries;
+	std::set<Age> m_evictable;
+	// Scratch list of eviction candidates, kept to save an allocation per miss.
+	std::vector<unsigned long> m_candidates;
+
+	bool makeRoom (const unsigned long textureID);
+	void evictable (std::vector<unsigned long>& textureIDs) const;
+	bool evictOldest();
+	void used (const unsigned long textureID);
+
+	LruAtlas(const LruAtlas&);
+	LruAtlas& operator=(const LruAtlas&);
+};
+
+void LruAtlas::touch (const unsigned long textureID)
+{
+	if (m_entries.count(textureID))
+	{
+		used(textureID);
+	}
+}
+
+// True also when evicting would make room; nothing is evicted until the texture is placed.
+bool LruAtlas::willFit (const unsigned long textureID)
+{
+	if (m_entries.count(textureID) || m_atlas->willFit(textureID))
+	{
+		return true;
+	}
+
+	evictable(m_candidates);
+	return !m_candidates.empty() && m_atlas->fitsWithout(textureID, m_candidates);
+}
+
+const AtlasedTexture* LruAtlas::addTexture (const unsigned long textureID)
+{
+	if (!m_entries.count(textureID) && !makeRoom(textureID))
+	{
+		return NULL;
+	}
+
+	const AtlasedTexture* texture = m_atlas->addTexture(textureID);
+	if (texture)
+	{
+		used(textureID);
+	}
+	return texture;
+}
+
+bool LruAtlas::removeTexture (const unsigned long textureID)
+{
+	std::map<unsigned long, Entry>::iterator found = m_entries.find(textureID);
+	if (found == m_entries.end() || found->second.references || !m_atlas->removeTexture(textureID))
+	{
+		return false;
+	}
+
+	m_evictable.erase(Age(found->second.lastUsed, textureID));
+	m_entries.erase(found);
+	return true;
+}
+
+bool LruAtlas::reserve (const unsigned long textureID)
+{
+	return (m_entries.count(textureID) || makeRoom(textureID)) && m_atlas->reserve(textureID);
+}
+
+const AtlasedTexture* LruAtlas::commit (const unsigned long textureID)
+{
+	const AtlasedTexture* texture = m_atlas->commit(textureID);
+	if (texture)
+	{
+		used(textureID);
+	}
+	return texture;
+}
+
+bool LruAtlas::fitsWithout (const unsigned long textureID, const std::vector<unsigned long>& removed)
+{
+	return m_atlas->fitsWithout(textureID, removed);
+}
+
+void LruAtlas::rollback (const unsigned long textureID)
+{
+	m_atlas->rollback(textureID);
+}
+
+void LruAtlas::retain (const unsigned long textureID)
+{
+	std::map<unsigned long, Entry>::iterator found = m_entries.find(textureID);
+	if (found == m_entries.end())
+	{
+		return;
+	}
+
+	if (found->second.references++ == 0)
+	{
+		m_evictable.erase(Age(found->second.lastUsed, textureID));
+	}
+	m_atlas->retain(textureID);
+}
+
+void LruAtlas::release (const unsigned long textureID)
+{
+	std::map<unsigned long, Entry>::iterator found = m_entries.find(textureID);
+	if (found == m_entries.end() || !found->second.references)
+	{
+		return;
+	}
+
+	if (--found->second.references == 0)
+	{
+		m_evictable.insert(Age(found->second.lastUsed, textureID));
+	}
+	m_atlas->release(textureID);
+}
+
+unsigned int LruAtlas::references (const unsigned long textureID) const
+{
+	std::map<unsigned long, Entry>::const_iterator found = m_entries.find(textureID);
+	return found == m_entries.end() ? 0 : found->second.references;
+}
+
+// Evicts oldest first, one at a time, once fitsWithout() says evicting every candidate
+// would make room; nothing is evicted for a texture it cannot.
+bool LruAtlas::makeRoom (const unsigned long textureID)
+{
+	if (m_atlas->willFit(textureID))
+	{
+		return true;
+	}
+
+	evictable(m_candidates);
+	if (m_candidates.empty() || !m_atlas->fitsWithout(textureID, m_candidates))
+	{
+		return false;
+	}
+
+	while (!m_atlas->willFit(textureID))
+	{
+		if (!evictOldest())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Oldest first, as evictOldest() takes them.
+void LruAtlas::evictable (std::vector<unsigned long>& textureIDs) const
+{
+	textureIDs.clear();
+	for (std::set<Age>::const_iterator age = m_evictable.begin(); age != m_evictable.end() && age->first < m_frame; ++age)
+	{
+		textureIDs.push_back(age->second);
+	}
+}
+
+bool LruAtlas::evictOldest()
+{
+	if (m_evictable.empty() || m_evictable.begin()->first >= m_frame)
+	{
+		return false;
+	}
+
+	const unsigned long textureID = m_evictable.begin()->second;
+	if (!m_atlas->removeTexture(textureID))
+	{
+		return false;
+	}
+
+	m_evictable.erase(m_evictable.begin());
+	m_entries.erase(textureID);
+	++m_evictions;
+	return true;
+}
+
+void LruAtlas::used (const unsigned long textureID)
+{
+	std::map<unsigned long, Entry>::iterator found = m_entries.find(textureID);
+	if (found == m_entries.end())
+	{
+		Entry entry = { 0, m_frame };
+		m_entries.insert(std::make_pair(textureID, entry));
+		m_evictable.insert(Age(m_frame, textureID));
+		return;
+	}
+
+	if (!found->second.references)
+	{
+		m_evictable.erase(Age(found->second.lastUsed, textureID));
+		m_evictable.insert(Age(m_frame, textureID));
+	}
+	found->second.lastUsed = m_frame;
+}
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef MAX_RECTS_ATLAS_CPP
+#define MAX_RECTS_ATLAS_CPP
+
+#include <vector>
+#include <stddef.h>
+#include "PackedAtlas.cpp"
+
+// MaxRects packer with the best short side fit heuristic. Slower to insert than the skyline
+// but denser, which suits offline and static atlases.
+class MaxRectsPacker : public RectPacker {
+public:
+	MaxRectsPacker(const unsigned int width, const unsigned int height);
+
+	bool fits (const unsigned int width, const unsigned int height) const;
+	bool insert (const unsigned int width, const unsigned int height, AtlasRect& placed);
+	void clear();
+	void saveState();
+	void restoreState();
+	RectPacker* createPage() const;
+	bool release (const AtlasRect& used);
+
+	inline size_t freeRectCount() const { return m_free.size(); };
+
+private:
+	std::vector<AtlasRect> m_free;
+	std::vector<AtlasRect> m_savedFree;
+	std::vector<AtlasRect> m_used;
+	std::vector<AtlasRect> m_savedUsed;
+	std::vector<AtlasRect> m_split;
+	std::vector<AtlasRect> m_created;
+	size_t m_firstNew;
+
+	void splitFreeRects (const AtlasRect& used);
+	void pruneFreeRects();
+
+	static bool contains (const AtlasRect& outer, const AtlasRect& inner);
+	static bool overlaps (const AtlasRect& a, const AtlasRect& b);
+};
+
+class MaxRectsAtlas : public PackedAtlas {
+public:
+	inline MaxRectsAtlas(TextureSource* source, const unsigned int width, const unsigned int height, const size_t pageLimit = 1) :
+		PackedAtlas(source, new MaxRectsPacker(width, height), pageLimit)
+	{};
+};
+
+MaxRectsPacker::MaxRectsPacker(const unsigned int width, const unsigned int height) :
+	RectPacker(width, height),
+	m_firstNew(0)
+{
+	clear();
+}
+
+void MaxRectsPacker::clear()
+{
+	m_free.clear();
+	m_used.clear();
+	AtlasRect page = { 0, 0, m_width, m_height };
+	m_free.push_back(page);
+}
+
+void MaxRectsPacker::saveState()
+{
+	m_savedFree = m_free;
+	m_savedUsed = m_used;
+}
+
+void MaxRectsPacker::restoreState()
+{
+	m_free = m_savedFree;
+	m_used = m_savedUsed;
+}
+
+RectPacker* MaxRectsPacker::createPage() const
+{
+	return new MaxRectsPacker(m_width, m_height);
+}
+
+// Every maximal free rect that is new after a release overlaps the freed rect; the others
+// were free before and are already in the list. So the page is split around the rects still
+// in use keeping only pieces that overlap the freed rect, which stays a short list, and the
+// result is merged into the free list. The freed space thus joins its free neighbours.
+bool MaxRectsPacker::release (const AtlasRect& used)
+{
+	size_t index = 0;
+	while (index < m_used.size() && (m_used[index].x != used.x || m_used[index].y != used.y ||
+		m_used[index].width != used.width || m_used[index].height != used.height))
+	{
+		++index;
+	}
+	if (index == m_used.size())
+	{
+		return false;
+	}
+
+	m_used.erase(m_used.begin() + index);
+
+	std::vector<AtlasRect> kept;
+	kept.swap(m_free);
+	AtlasRect page = { 0, 0, m_width, m_height };
+	m_free.push_back(page);
+	for (size_t i = 0; i < m_used.size() && !m_free.empty(); ++i)
+	{
+		splitFreeRects(m_used[i]);
+		pruneFreeRects();
+		for (size_t j = 0; j < m_free.size(); ++j)
+		{
+			if (!overlaps(m_free[j], used))
+			{
+				m_free[j] = m_free.back();
+				m_free.pop_back();
+				--j;
+			}
+		}
+	}
+
+	m_free.swap(kept);
+	m_firstNew = m_free.size();
+	m_free.insert(m_free.end(), kept.begin(), kept.end());
+	pruneFreeRects();
+	return true;
+}
+
+bool MaxRectsPacker::fits (const unsigned int width, const unsigned int height) const
+{
+	for (size_t i = 0; i < m_free.size(); ++i)
+	{
+		if (width <= m_free[i].width && height <= m_free[i].height)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool MaxRectsPacker::insert (const unsigned int width, const unsigned int height, AtlasRect& placed)
+{
+	bool found = false;
+	unsigned int bestShort = 0;
+	unsigned int bestLong = 0;
+
+	for (size_t i = 0; i < m_free.size(); ++i)
+	{
+		const AtlasRect& candidate = m_free[i];
+		if (width > candidate.width || height > candidate.height)
+		{
+			continue;
+		}
+
+		const unsigned int leftoverX = candidate.width - width;
+		const unsigned int leftoverY = candidate.height - height;
+		const unsigned int shortSide = leftoverX < leftoverY ? leftoverX : leftoverY;
+		const unsigned int longSide = leftoverX < leftoverY ? leftoverY : leftoverX;
+		if (!found || shortSide < bestShort || (shortSide == bestShort && longSide < bestLong))
+		{
+			found = true;
+			bestShort = shortSide;
+			bestLong = longSide;
+			placed.x = candidate.x;
+			placed.y = candidate.y;
+		}
+	}
+
+	if (!found)
+	{
+		return false;
+	}
+
+	placed.width = width;
+	placed.height = height;
+	if (width && height)
+	{
+		splitFreeRects(placed);
+		pruneFreeRects();
+		m_used.push_back(placed);
+	}
+	return true;
+}
+
+// Every free rect overlapping the used one is replaced by up to four maximal rects around it.
+// Untouched rects are kept first and the new ones appended after m_firstNew for pruning.
+void MaxRectsPacker::splitFreeRects (const AtlasRect& used)
+{
+	m_split.clear();
+	m_created.clear();
+	for (size_t i = 0; i < m_free.size(); ++i)
+	{
+		const AtlasRect rect = m_free[i];
+		if (!overlaps(used, rect))
+		{
+			m_split.push_back(rect);
+			continue;
+		}
+
+		if (used.x > rect.x)
+		{
+			AtlasRect left = { rect.x, rect.y, used.x - rect.x, rect.height };
+			m_created.push_back(left);
+		}
+		if (used.x + used.width < rect.x + rect.width)
+		{
+			AtlasRect right = { used.x + used.width, rect.y, rect.x + rect.width - (used.x + used.width), rect.height };
+			m_created.push_back(right);
+		}
+		if (used.y > rect.y)
+		{
+			AtlasRect below = { rect.x, rect.y, rect.width, used.y - rect.y };
+			m_created.push_back(below);
+		}
+		if (used.y + used.height < rect.y + rect.height)
+		{
+			AtlasRect above = { rect.x, used.y + used.height, rect.width, rect.y + rect.height - (used.y + used.height) };
+			m_created.push_back(above);
+		}
+	}
+
+	m_firstNew = m_split.size();
+	m_split.insert(m_split.end(), m_created.begin(), m_created.end());
+	m_free.swap(m_split);
+}
+
+// The untouched rects were already pruned against each other, so only pairs involving a
+// new rect need checking: O(new * free) rather than O(free^2) per insert.
+void MaxRectsPacker::pruneFreeRects()
+{
+	for (size_t i = m_firstNew; i < m_free.size(); ++i)
+	{
+		bool redundant = false;
+		for (size_t j = 0; j < m_free.size(); ++j)
+		{
+			if (i == j)
+			{
+				continue;
+			}
+			if (contains(m_free[j], m_free[i]))
+			{
+				redundant = true;
+				break;
+			}
+		}
+		if (redundant)
+		{
+			m_free.erase(m_free.begin() + i);
+			--i;
+			continue;
+		}
+
+		for (size_t j = 0; j < m_firstNew; ++j)
+		{
+			if (contains(m_free[i], m_free[j]))
+			{
+				m_free.erase(m_free.begin() + j);
+				--j;
+				--m_firstNew;
+				--i;
+			}
+		}
+	}
+}
+
+bool MaxRectsPacker::contains (const AtlasRect& outer, const AtlasRect& inner)
+{
+	return inner.x >= outer.x && inner.y >= outer.y &&
+		inner.x + inner.width <= outer.x + outer.width &&
+		inner.y + inner.height <= outer.y + outer.height;
+}
+
+bool MaxRectsPacker::overlaps (const AtlasRect& a, const AtlasRect& b)
+{
+	return a.x < b.x + b.width && b.x < a.x + a.width &&
+		a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+#endif
@@ -0,0 +1,1048 @@
+#ifndef PACKED_ATLAS_CPP
+#define PACKED_ATLAS_CPP
+
+#include <map>
+#include <set>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "min_deps.cpp"
+#include "AtlasPixels.cpp"
+#include "AtlasBlocks.cpp"
+#include "AtlasRect.cpp"
+#include "DirtyRects.cpp"
+#include "ContentHash.cpp"
+
+// Where atlases learn how big a texture is; TextureManager::Atlas only passes ids around.
+class TextureSource {
+public:
+	virtual ~TextureSource() {};
+	virtual bool getSize (const unsigned long textureID, unsigned int& width, unsigned int& height) = 0;
+	// RGBA8 image, width pixels per row with no padding, for atlases with a backing store.
+	// NULL when the source keeps no CPU copy.
+	virtual const uint32_t* getPixels (const unsigned long) { return NULL; };
+	// Block-compressed image for atlases with a block store: rows of ceil(width / block size)
+	// blocks, tightly packed. NULL when the source keeps no compressed copy.
+	virtual const uint8_t* getBlocks (const unsigned long) { return NULL; };
+};
+
+// A texture's place in a PackedAtlas layout.
+struct AtlasPlacement {
+	unsigned long textureID;
+	AtlasRect rect;
+	unsigned int page;
+};
+
+// Where a repack moved a texture. Its pixels have to be copied from `from` to `to` before
+// anything is drawn with the new UVs.
+struct AtlasRemap {
+	unsigned long textureID;
+	AtlasedTexture from;
+	AtlasedTexture to;
+};
+
+// CPU-side rectangle allocator for one atlas page.
+class RectPacker {
+public:
+	inline RectPacker(const unsigned int width, const unsigned int height) : m_width(width), m_height(height) {};
+	virtual ~RectPacker() {};
+
+	virtual bool fits (const unsigned int width, const unsigned int height) const = 0;
+	virtual bool insert (const unsigned int width, const unsigned int height, AtlasRect& placed) = 0;
+	virtual void clear() = 0;
+	// One saved copy of the allocation state, for rolling back reservations.
+	virtual void saveState() = 0;
+	virtual void restoreState() = 0;
+	// An empty packer of the same kind and size, for atlases that grow extra pages.
+	virtual RectPacker* createPage() const = 0;
+	// Gives a placed rect back. Packers that cannot reuse freed space return false and are
+	// only reclaimed once their page is empty.
+	virtual bool release (const AtlasRect&) { return false; };
+
+	inline unsigned int width() const { return m_width; };
+	inline unsigned int height() const { return m_height; };
+
+protected:
+	const unsigned int m_width;
+	const unsigned int m_height;
+};
+
+// TextureManager::Atlas over RectPacker pages. Textures are placed once; adding one already
+// in the atlas returns its existing AtlasedTexture. When no page has room and the page limit
+// allows, another page is allocated and reported as AtlasedTexture::layer, so a catalogue
+// can stay open on a texture array instead of starting a new batch.
+class PackedAtlas : public TextureManager::Atlas {
+public:
+	PackedAtlas(TextureSource* source, RectPacker* firstPage, const size_t pageLimit = 1);
+	virtual ~PackedAtlas();
+
+	bool willFit (const unsigned long textureID);
+	const AtlasedTexture* addTexture (const unsigned long textureID);
+	const AtlasedTexture* find (const unsigned long textureID) const;
+	bool removeTexture (const unsigned long textureID);
+	bool fitsWithout (const unsigned long textureID, const std::vector<unsigned long>& removed);
+
+	bool reserve (const unsigned long textureID);
+	const AtlasedTexture* commit (const unsigned long textureID);
+	void rollback (const unsigned long textureID);
+
+	inline size_t textureCount() const { return m_textures.size(); };
+	inline unsigned long long usedArea() const { return m_usedArea; };
+	inline size_t pageCount() const { return m_pages.size(); };
+	inline size_t pageLimit() const { return m_pageLimit; };
+	inline unsigned int pageWidth() const { return m_pages[0]->width(); };
+	inline unsigned int pageHeight() const { return m_pages[0]->height(); };
+	float occupancy() const;
+
+	// Repacking: layout() snapshots every placement, createEmptyPage() makes a page to pack
+	// a new layout into, and adoptLayout() switches to it.
+	void layout (std::vector<AtlasPlacement>& placements) const;
+	inline RectPacker* createEmptyPage() const { return m_pages[0]->createPage(); };
+	bool adoptLayout (std::vector<RectPacker*>& pages, const std::vector<AtlasPlacement>& placements, std::vector<AtlasRemap>& remap);
+
+	// These must be set while the atlas is empty. The gutter pads every allocation on all
+	// sides and the backing store, if enabled, gets each image blitted in with its edges
+	// extruded. In block-aligned mode every allocation is rounded up to whole blocks, so all
+	// rects sit on block boundaries as compressed formats need; the gutter and the page size
+	// must then be whole blocks, and a block store can replace the RGBA8 backing store once
+	// the block size is set.
+	bool setGutter (const unsigned int gutter);
+	bool setBlockSize (const unsigned int blockSize);
+	bool enableBackingStore();
+	bool enableBlockStore (const unsigned int bytesPerBlock);
+	inline unsigned int gutter() const { return m_gutter; };
+	inline unsigned int blockSize() const { return m_blockSize; };
+	inline const AtlasPixels* backingStore() const { return m_pixels; };
+	inline const AtlasBlocks* blockStore() const { return m_blocks; };
+
+	// Set while empty. Textures whose image (pixels or blocks) hashes the same as one already
+	// placed share its region instead of taking their own; find() returns a copy of the
+	// shared rect under each id. The region is freed when the last texture using it is removed.
+	bool enableDeduplication();
+	inline size_t duplicateCount() const { return m_aliasOwners.size(); };
+
+	// Set while empty, and not with a block store. Fully transparent borders of each image
+	// are cut off before packing; AtlasedTexture keeps the cut margins and the source size.
+	bool enableTrimming();
+
+	// Preferred pages, e.g. from an offline PageGrouping: a hinted texture goes on its page
+	// while that page has room, and first fit like any other texture once it has not.
+	inline void setPageHint (const unsigned long textureID, const unsigned int page) { m_pageHints[textureID] = page; };
+	inline size_t pageHintCount() const { return m_pageHints.size(); };
+
+	// Once per frame: the merged rects written since the last call, one upload call each.
+	// The call cost (see DirtyRects) applies from the next take.
+	void takeDirtyRects (std::vector<AtlasDirtyRect>& rects);
+	size_t upload (AtlasUploader& uploader);
+	inline void setUploadCallCost (const unsigned long long callCost) { m_dirty.setCallCost(callCost); };
+	inline unsigned long long uploadCallCost() const { return m_dirty.callCost(); };
+
+protected:
+	TextureSource* m_source;
+	std::vector<RectPacker*> m_pages;
+	const size_t m_pageLimit;
+	size_t m_savedPageCount;
+	std::vector<size_t> m_pageTextures;
+	unsigned int m_gutter;
+	unsigned int m_blockSize;
+	AtlasPixels* m_pixels;
+	AtlasBlocks* m_blocks;
+	DirtyRects m_dirty;
+	std::vector<AtlasDirtyRect> m_uploads;
+	std::map<unsigned long, AtlasedTexture> m_textures;
+	unsigned long long m_usedArea;
+
+	// Deduplication: the texture owning each content hash's region, the hash of each owner
+	// and the owner each duplicate shares. Only owners count towards pages and usedArea; a
+	// one-entry cache keeps willFit and addTexture from hashing the same image twice, so a
+	// texture id's image must not change while the atlas knows it.
+	bool m_deduplicate;
+	std::map<uint64_t, unsigned long> m_contentOwners;
+	std::map<unsigned long, uint64_t> m_ownerHashes;
+	std::map<unsigned long, unsigned long> m_aliasOwners;
+	unsigned long m_hashedTexture;
+	uint64_t m_hashedContent;
+	bool m_hashed;
+
+	// The part of a texture's image that gets stored: all of it unless trimming cut borders.
+	struct Footprint {
+		unsigned int width;
+		unsigned int height;
+		unsigned int trimX;
+		unsigned int trimY;
+		unsigned int sourceWidth;
+		unsigned int sourceHeight;
+	};
+
+	// Trimming, and the last texture measured so a willFit or reserve and the place that
+	// follows scan its image once.
+	bool m_trim;
+	unsigned long m_measuredTexture;
+	Footprint m_measured;
+	bool m_hasMeasured;
+
+	// Reservations and commits since the packer state was saved, in reservation order.
+	struct Reservation {
+		unsigned long textureID;
+		AtlasRect rect;
+		unsigned int page;
+		Footprint footprint;
+		bool committed;
+	};
+	std::vector<Reservation> m_transaction;
+	std::map<unsigned long, unsigned int> m_pageHints;
+
+	bool canAllocate (const unsigned int width, const unsigned int height) const;
+	bool allocate (const unsigned long textureID, const unsigned int width, const unsigned int height, AtlasRect& rect, unsigned int& page);
+	void saveState();
+	void restoreState();
+	Reservation* findReservation (const unsigned long textureID);
+	void endTransactionIfSettled();
+	const AtlasedTexture* place (const unsigned long textureID, const AtlasRect& rect, const unsigned int page, const Footprint& footprint);
+	bool measure (const unsigned long textureID, Footprint& footprint);
+	void setRect (AtlasedTexture& texture, const AtlasRect& rect, const unsigned int page) const;
+	AtlasRect outerRect (const AtlasedTexture& texture) const;
+	void writeImage (const unsigned long textureID, const AtlasedTexture& texture);
+	inline bool isEmpty() const { return m_textures.empty() && m_transaction.empty(); };
+	inline bool isAlias (const unsigned long textureID) const { return m_aliasOwners.count(textureID) != 0; };
+	const void* content (const unsigned long textureID, const unsigned int width, const unsigned int height, size_t& bytes) const;
+	bool hashContent (const unsigned long textureID, const unsigned int width, const unsigned int height, uint64_t& hash);
+	const AtlasedTexture* findDuplicate (const unsigned long textureID);
+	void syncAliases();
+	bool handOverRegion (const unsigned long owner);
+	inline unsigned int allocationSize (const unsigned int size) const { return (size + 2 * m_gutter + m_blockSize - 1) / m_blockSize * m_blockSize; };
+	bool abandonLayout (std::vector<RectPacker*>& previous);
+
+	static void deletePages (std::vector<RectPacker*>& pages);
+
+private:
+	PackedAtlas(const PackedAtlas&);
+	PackedAtlas& operator=(const PackedAtlas&);
+};
+
+PackedAtlas::PackedAtlas(TextureSource* source, RectPacker* firstPage, const size_t pageLimit) :
+	m_source(source),
+	m_pageLimit(pageLimit ? pageLimit : 1),
+	m_savedPageCount(0),
+	m_gutter(0),
+	m_blockSize(1),
+	m_pixels(NULL),
+	m_blocks(NULL),
+	m_usedArea(0),
+	m_deduplicate(false),
+	m_hashedTexture(0),
+	m_hashedContent(0),
+	m_hashed(false),
+	m_trim(false),
+	m_measuredTexture(0),
+	m_hasMeasured(false)
+{
+	m_pages.push_back(firstPage);
+	m_pageTextures.assign(m_pageLimit, 0);
+}
+
+PackedAtlas::~PackedAtlas()
+{
+	deletePages(m_pages);
+	delete m_pixels;
+	delete m_blocks;
+}
+
+bool PackedAtlas::setGutter (const unsigned int gutter)
+{
+	if (!isEmpty() || gutter % m_blockSize)
+	{
+		return false;
+	}
+
+	m_gutter = gutter;
+	return true;
+}
+
+bool PackedAtlas::setBlockSize (const unsigned int blockSize)
+{
+	if (!isEmpty() || !blockSize || m_gutter % blockSize || pageWidth() % blockSize || pageHeight() % blockSize || m_blocks)
+	{
+		return false;
+	}
+
+	m_blockSize = blockSize;
+	return true;
+}
+
+bool PackedAtlas::enableBlockStore (const unsigned int bytesPerBlock)
+{
+	if (!isEmpty() || !bytesPerBlock || m_blockSize < 2 || m_pixels || m_trim)
+	{
+		return false;
+	}
+
+	if (!m_blocks)
+	{
+		m_blocks = new AtlasBlocks(pageWidth(), pageHeight(), m_blockSize, bytesPerBlock);
+	}
+	return true;
+}
+
+bool PackedAtlas::enableDeduplication()
+{
+	if (!isEmpty())
+	{
+		return false;
+	}
+
+	m_deduplicate = true;
+	return true;
+}
+
+bool PackedAtlas::enableTrimming()
+{
+	if (!isEmpty() || m_blocks)
+	{
+		return false;
+	}
+
+	m_trim = true;
+	return true;
+}
+
+bool PackedAtlas::enableBackingStore()
+{
+	if (!isEmpty() || m_blocks)
+	{
+		return false;
+	}
+
+	if (!m_pixels)
+	{
+		m_pixels = new AtlasPixels(pageWidth(), pageHeight());
+	}
+	return true;
+}
+
+bool PackedAtlas::willFit (const unsigned long textureID)
+{
+	if (m_textures.count(textureID) || findDuplicate(textureID))
+	{
+		return true;
+	}
+
+	Footprint footprint;
+	if (!measure(textureID, footprint))
+	{
+		return false;
+	}
+
+	return canAllocate(allocationSize(footprint.width), allocationSize(footprint.height));
+}
+
+const AtlasedTexture* PackedAtlas::addTexture (const unsigned long textureID)
+{
+	const AtlasedTexture* existing = find(textureID);
+	if (existing)
+	{
+		return existing;
+	}
+
+	const AtlasedTexture* duplicate = findDuplicate(textureID);
+	if (duplicate)
+	{
+		m_aliasOwners[textureID] = m_contentOwners[m_hashedContent];
+		AtlasedTexture& alias = m_textures[textureID];
+		alias = *duplicate;
+		return &alias;
+	}
+	if (!m_transaction.empty())
+	{
+		return reserve(textureID) ? commit(textureID) : NULL;
+	}
+
+	Footprint footprint;
+	unsigned int page;
+	AtlasRect rect;
+	if (!measure(textureID, footprint) || !allocate(textureID, allocationSize(footprint.width), allocationSize(footprint.height), rect, page))
+	{
+		return NULL;
+	}
+
+	return place(textureID, rect, page, footprint);
+}
+
+const AtlasedTexture* PackedAtlas::find (const unsigned long textureID) const
+{
+	std::map<unsigned long, AtlasedTexture>::const_iterator found = m_textures.find(textureID);
+	return found == m_textures.end() ? NULL : &found->second;
+}
+
+// Not allowed while a transaction is open, since rollback replays from the saved state.
+bool PackedAtlas::removeTexture (const unsigned long textureID)
+{
+	std::map<unsigned long, AtlasedTexture>::iterator found = m_textures.find(textureID);
+	if (found == m_textures.end() || !m_transaction.empty())
+	{
+		return false;
+	}
+
+	std::map<unsigned long, unsigned long>::iterator alias = m_aliasOwners.find(textureID);
+	if (alias != m_aliasOwners.end())
+	{
+		m_aliasOwners.erase(alias);
+		m_textures.erase(found);
+		return true;
+	}
+	if (m_ownerHashes.count(textureID) && handOverRegion(textureID))
+	{
+		m_textures.erase(found);
+		return true;
+	}
+
+	const AtlasedTexture& texture = found->second;
+	const AtlasRect rect = outerRect(texture);
+	RectPacker* page = m_pages[texture.layer];
+	if (--m_pageTextures[texture.layer] == 0)
+	{
+		page->clear();
+	}
+	else if (rect.width && rect.height)
+	{
+		page->release(rect);
+	}
+
+	m_usedArea -= (unsigned long long)rect.width * rect.height;
+	m_textures.erase(found);
+	return true;
+}
+
+// Replays the removals on each page's packer and restores it: a page left empty takes
+// anything the page size allows, others get back only what their packer releases. The
+// replay goes in the order given and stops at the first release that makes room, so an
+// oldest-first list costs about as much as the evictions it would take. Aliases and owners
+// still shared by an alias free nothing, as in removeTexture().
+bool PackedAtlas::fitsWithout (const unsigned long textureID, const std::vector<unsigned long>& removed)
+{
+	if (willFit(textureID))
+	{
+		return true;
+	}
+
+	Footprint footprint;
+	if (!m_transaction.empty() || !measure(textureID, footprint))
+	{
+		return false;
+	}
+	const unsigned int width = allocationSize(footprint.width);
+	const unsigned int height = allocationSize(footprint.height);
+	if (width > pageWidth() || height > pageHeight())
+	{
+		return false;
+	}
+
+	const std::set<unsigned long> gone(removed.begin(), removed.end());
+	std::set<unsigned long> shared;
+	for (std::map<unsigned long, unsigned long>::const_iterator alias = m_aliasOwners.begin(); alias != m_aliasOwners.end(); ++alias)
+	{
+		if (!gone.count(alias->first))
+		{
+			shared.insert(alias->second);
+		}
+	}
+
+	std::vector<size_t> remaining(m_pageTextures);
+	std::vector<std::vector<AtlasRect> > freed(m_pages.size());
+	std::set<unsigned long> counted;
+	for (size_t i = 0; i < removed.size(); ++i)
+	{
+		std::map<unsigned long, AtlasedTexture>::const_iterator found = m_textures.find(removed[i]);
+		if (found == m_textures.end() || isAlias(removed[i]) || shared.count(removed[i]) || !counted.insert(removed[i]).second)
+		{
+			continue;
+		}
+		--remaining[found->second.layer];
+		freed[found->second.layer].push_back(outerRect(found->second));
+	}
+
+	bool fits = false;
+	for (size_t page = 0; page < m_pages.size() && !fits; ++page)
+	{
+		if (freed[page].empty())
+		{
+			continue;
+		}
+		if (remaining[page] == 0)
+		{
+			fits = true;
+			continue;
+		}
+
+		m_pages[page]->saveState();
+		for (size_t i = 0; i < freed[page].size() && !fits; ++i)
+		{
+			if (!m_pages[page]->release(freed[page][i]))
+			{
+				break;
+			}
+			fits = m_pages[page]->fits(width, height);
+		}
+		m_pages[page]->restoreState();
+	}
+	return fits;
+}
+
+bool PackedAtlas::reserve (const unsigned long textureID)
+{
+	if (find(textureID) || findReservation(textureID) || findDuplicate(textureID))
+	{
+		return true;
+	}
+
+	Footprint footprint;
+	if (!measure(textureID, footprint) || !canAllocate(allocationSize(footprint.width), allocationSize(footprint.height)))
+	{
+		return false;
+	}
+
+	if (m_transaction.empty())
+	{
+		saveState();
+	}
+
+	Reservation reservation = { textureID, AtlasRect(), 0, footprint, false };
+	allocate(textureID, allocationSize(footprint.width), allocationSize(footprint.height), reservation.rect, reservation.page);
+	m_transaction.push_back(reservation);
+	return true;
+}
+
+const AtlasedTexture* PackedAtlas::commit (const unsigned long textureID)
+{
+	Reservation* reservation = findReservation(textureID);
+	if (!reservation)
+	{
+		return addTexture(textureID);
+	}
+
+	reservation->committed = true;
+	const AtlasedTexture* texture = place(textureID, reservation->rect, reservation->page, reservation->footprint);
+	endTransactionIfSettled();
+	return texture;
+}
+
+// Restores the saved page states and replays the rest of the transaction. With rollbacks
+// in reverse reservation order the replay lands every remaining rect where it was.
+void PackedAtlas::rollback (const unsigned long textureID)
+{
+	Reservation* reservation = findReservation(textureID);
+	if (!reservation)
+	{
+		return;
+	}
+
+	m_transaction.erase(m_transaction.begin() + (reservation - &m_transaction[0]));
+	restoreState();
+
+	for (size_t i = 0; i < m_transaction.size(); ++i)
+	{
+		allocate(m_transaction[i].textureID, m_transaction[i].rect.width, m_transaction[i].rect.height, m_transaction[i].rect, m_transaction[i].page);
+	}
+	endTransactionIfSettled();
+}
+
+// The transaction ends once every reservation left in it is committed.
+void PackedAtlas::endTransactionIfSettled()
+{
+	for (size_t i = 0; i < m_transaction.size(); ++i)
+	{
+		if (!m_transaction[i].committed)
+		{
+			return;
+		}
+	}
+	m_transaction.clear();
+}
+
+bool PackedAtlas::canAllocate (const unsigned int width, const unsigned int height) const
+{
+	for (size_t i = 0; i < m_pages.size(); ++i)
+	{
+		if (m_pages[i]->fits(width, height))
+		{
+			return true;
+		}
+	}
+
+	return m_pages.size() < m_pageLimit && width <= pageWidth() && height <= pageHeight();
+}
+
+// First page with room, else a new page while under the limit.
+// A hint for a page past the last one opens the pages up to it, which keeps canAllocate()
+// right: either the hinted page is new and empty, or no page was added.
+bool PackedAtlas::allocate (const unsigned long textureID, const unsigned int width, const unsigned int height, AtlasRect& rect, unsigned int& page)
+{
+	std::map<unsigned long, unsigned int>::const_iterator hint = m_pageHints.find(textureID);
+	if (hint != m_pageHints.end() && hint->second < m_pageLimit && width <= pageWidth() && height <= pageHeight())
+	{
+		while (m_pages.size() <= hint->second)
+		{
+			m_pages.push_back(m_pages[0]->createPage());
+		}
+		if (m_pages[hint->second]->insert(width, height, rect))
+		{
+			page = hint->second;
+			return true;
+		}
+	}
+
+	for (size_t i = 0; i < m_pages.size(); ++i)
+	{
+		if (m_pages[i]->insert(width, height, rect))
+		{
+			page = (unsigned int)i;
+			return true;
+		}
+	}
+
+	if (m_pages.size() >= m_pageLimit || width > pageWidth() || height > pageHeight())
+	{
+		return false;
+	}
+
+	m_pages.push_back(m_pages[0]->createPage());
+	page = (unsigned int)(m_pages.size() - 1);
+	return m_pages.back()->insert(width, height, rect);
+}
+
+void PackedAtlas::saveState()
+{
+	m_savedPageCount = m_pages.size();
+	for (size_t i = 0; i < m_pages.size(); ++i)
+	{
+		m_pages[i]->saveState();
+	}
+}
+
+void PackedAtlas::restoreState()
+{
+	while (m_pages.size() > m_savedPageCount)
+	{
+		delete m_pages.back();
+		m_pages.pop_back();
+	}
+	for (size_t i = 0; i < m_pages.size(); ++i)
+	{
+		m_pages[i]->restoreState();
+	}
+}
+
+PackedAtlas::Reservation* PackedAtlas::findReservation (const unsigned long textureID)
+{
+	for (size_t i = 0; i < m_transaction.size(); ++i)
+	{
+		if (m_transaction[i].textureID == textureID && !m_transaction[i].committed)
+		{
+			return &m_transaction[i];
+		}
+	}
+	return NULL;
+}
+
+void PackedAtlas::layout (std::vector<AtlasPlacement>& placements) const
+{
+	placements.clear();
+	placements.reserve(m_textures.size());
+	for (std::map<unsigned long, AtlasedTexture>::const_iterator it = m_textures.begin(); it != m_textures.end(); ++it)
+	{
+		if (isAlias(it->first))
+		{
+			continue;
+		}
+		const AtlasPlacement placement = { it->first, outerRect(it->second), it->second.layer };
+		placements.push_back(placement);
+	}
+}
+
+// Takes ownership of pages, which must hold the placements. The layout may be older than the
+// atlas: textures removed since are released from the new pages and textures added since
+// are placed in them. A page whose packer cannot release is cleared and refilled with its
+// remaining placements in their order, which may move them. Fails, keeping the current
+// layout, if those do not fit, a transaction is open or there is no backing or block store:
+// the rects are rewritten in place, so the moved pixels must be in the store to upload.
+// remap receives every texture whose rect or page changed. AtlasedTexture pointers handed
+// out before stay valid and see the new rects.
+bool PackedAtlas::adoptLayout (std::vector<RectPacker*>& pages, const std::vector<AtlasPlacement>& placements, std::vector<AtlasRemap>& remap)
+{
+	remap.clear();
+
+	std::vector<RectPacker*> previous;
+	previous.swap(m_pages);
+	m_pages.swap(pages);
+	if (m_pages.empty() || m_pages.size() > m_pageLimit || !m_transaction.empty() || (!m_pixels && !m_blocks))
+	{
+		return abandonLayout(previous);
+	}
+
+	std::map<unsigned long, AtlasPlacement> moved;
+	std::vector<bool> refill(m_pages.size(), false);
+	for (size_t i = 0; i < placements.size(); ++i)
+	{
+		if (placements[i].page >= m_pages.size())
+		{
+			return abandonLayout(previous);
+		}
+		if (m_textures.count(placements[i].textureID))
+		{
+			moved[placements[i].textureID] = placements[i];
+		}
+		else if (placements[i].rect.width && placements[i].rect.height && !m_pages[placements[i].page]->release(placements[i].rect))
+		{
+			refill[placements[i].page] = true;
+		}
+	}
+
+	for (size_t page = 0; page < m_pages.size(); ++page)
+	{
+		if (refill[page])
+		{
+			m_pages[page]->clear();
+		}
+	}
+	for (size_t i = 0; i < placements.size(); ++i)
+	{
+		std::map<unsigned long, AtlasPlacement>::iterator placement = moved.find(placements[i].textureID);
+		if (!refill[placements[i].page] || placement == moved.end() || !placement->second.rect.width || !placement->second.rect.height)
+		{
+			continue;
+		}
+		if (!m_pages[placement->second.page]->insert(placement->second.rect.width, placement->second.rect.height, placement->second.rect))
+		{
+			return abandonLayout(previous);
+		}
+	}
+
+	for (std::map<unsigned long, AtlasedTexture>::const_iterator it = m_textures.begin(); it != m_textures.end(); ++it)
+	{
+		if (moved.count(it->first) || isAlias(it->first))
+		{
+			continue;
+		}
+
+		AtlasPlacement placement = { it->first, outerRect(it->second), 0 };
+		if (!allocate(placement.textureID, placement.rect.width, placement.rect.height, placement.rect, placement.page))
+		{
+			return abandonLayout(previous);
+		}
+		moved[it->first] = placement;
+	}
+
+	AtlasPixels* pixels = m_pixels ? new AtlasPixels(pageWidth(), pageHeight()) : NULL;
+	AtlasBlocks* blocks = m_blocks ? new AtlasBlocks(pageWidth(), pageHeight(), m_blockSize, m_blocks->bytesPerBlock()) : NULL;
+	m_pageTextures.assign(m_pageLimit, 0);
+	for (std::map<unsigned long, AtlasedTexture>::iterator it = m_textures.begin(); it != m_textures.end(); ++it)
+	{
+		if (isAlias(it->first))
+		{
+			continue;
+		}
+		const AtlasPlacement& placement = moved[it->first];
+		AtlasRemap entry = { it->first, it->second, AtlasedTexture() };
+		const AtlasRect from = outerRect(it->second);
+		if (pixels)
+		{
+			pixels->copy(*m_pixels, it->second.layer, from.x, from.y, from.width, from.height, placement.page, placement.rect.x, placement.rect.y);
+		}
+		if (blocks)
+		{
+			blocks->copy(*m_blocks, it->second.layer, from.x, from.y, from.width, from.height, placement.page, placement.rect.x, placement.rect.y);
+		}
+		setRect(it->second, placement.rect, placement.page);
+		++m_pageTextures[placement.page];
+
+		entry.to = it->second;
+		if (entry.from.x != entry.to.x || entry.from.y != entry.to.y || entry.from.layer != entry.to.layer)
+		{
+			remap.push_back(entry);
+			m_dirty.add(placement.page, placement.rect);
+		}
+	}
+
+	if (pixels)
+	{
+		delete m_pixels;
+		m_pixels = pixels;
+	}
+	if (blocks)
+	{
+		delete m_blocks;
+		m_blocks = blocks;
+	}
+	syncAliases();
+	deletePages(previous);
+	return true;
+}
+
+void PackedAtlas::takeDirtyRects (std::vector<AtlasDirtyRect>& rects)
+{
+	m_dirty.take(rects);
+}
+
+// Returns the number of upload calls made.
+size_t PackedAtlas::upload (AtlasUploader& uploader)
+{
+	takeDirtyRects(m_uploads);
+	for (size_t i = 0; i < m_uploads.size(); ++i)
+	{
+		const AtlasDirtyRect& dirty = m_uploads[i];
+		if (m_blocks)
+		{
+			const uint8_t* blocks = dirty.page < m_blocks->pageCount() ? m_blocks->block(dirty.page, dirty.rect.x, dirty.rect.y) : NULL;
+			uploader.uploadBlocks(dirty.page, dirty.rect, blocks, m_blocks->rowBytes());
+			continue;
+		}
+
+		const uint32_t* pixels = NULL;
+		if (m_pixels && dirty.page < m_pixels->pageCount())
+		{
+			pixels = m_pixels->row(dirty.page, dirty.rect.y) + dirty.rect.x;
+		}
+		uploader.upload(dirty.page, dirty.rect, pixels, pageWidth());
+	}
+	return m_uploads.size();
+}
+
+// Puts the previous pages back and deletes the rejected ones.
+bool PackedAtlas::abandonLayout (std::vector<RectPacker*>& previous)
+{
+	m_pages.swap(previous);
+	deletePages(previous);
+	return false;
+}
+
+void PackedAtlas::deletePages (std::vector<RectPacker*>& pages)
+{
+	for (size_t i = 0; i < pages.size(); ++i)
+	{
+		delete pages[i];
+	}
+	pages.clear();
+}
+
+float PackedAtlas::occupancy() const
+{
+	return (float)m_usedArea / ((float)pageWidth() * (float)pageHeight() * (float)m_pages.size());
+}
+
+const AtlasedTexture* PackedAtlas::place (const unsigned long textureID, const AtlasRect& rect, const unsigned int page, const Footprint& footprint)
+{
+	AtlasedTexture& texture = m_textures[textureID];
+	texture.width = footprint.width;
+	texture.height = footprint.height;
+	texture.trimX = footprint.trimX;
+	texture.trimY = footprint.trimY;
+	texture.sourceWidth = footprint.sourceWidth;
+	texture.sourceHeight = footprint.sourceHeight;
+	setRect(texture, rect, page);
+	++m_pageTextures[page];
+
+	uint64_t hash;
+	if (m_deduplicate && hashContent(textureID, footprint.sourceWidth, footprint.sourceHeight, hash) && !m_contentOwners.count(hash))
+	{
+		m_contentOwners[hash] = textureID;
+		m_ownerHashes[textureID] = hash;
+	}
+	m_dirty.add(page, rect);
+	if (m_pixels || m_blocks)
+	{
+		writeImage(textureID, texture);
+	}
+
+	m_usedArea += (unsigned long long)rect.width * rect.height;
+	return &texture;
+}
+
+// rect is the allocation, gutter and block rounding included; texture already has its size
+// and gets the top-left part inside the gutter.
+void PackedAtlas::setRect (AtlasedTexture& texture, const AtlasRect& rect, const unsigned int page) const
+{
+	texture.x = rect.x + m_gutter;
+	texture.y = rect.y + m_gutter;
+	texture.layer = page;
+	texture.u0 = (float)texture.x / pageWidth();
+	texture.v0 = (float)texture.y / pageHeight();
+	texture.u1 = (float)(texture.x + texture.width) / pageWidth();
+	texture.v1 = (float)(texture.y + texture.height) / pageHeight();
+}
+
+AtlasRect PackedAtlas::outerRect (const AtlasedTexture& texture) const
+{
+	const AtlasRect rect = { texture.x - m_gutter, texture.y - m_gutter, allocationSize(texture.width), allocationSize(texture.height) };
+	return rect;
+}
+
+void PackedAtlas::writeImage (const unsigned long textureID, const AtlasedTexture& texture)
+{
+	if (m_blocks)
+	{
+		const uint8_t* blocks = m_source->getBlocks(textureID);
+		if (blocks)
+		{
+			const size_t stride = (size_t)((texture.width + m_blockSize - 1) / m_blockSize) * m_blocks->bytesPerBlock();
+			m_blocks->blit(texture.layer, texture.x, texture.y, texture.width, texture.height, blocks, stride);
+			m_blocks->extrude(texture.layer, texture.x, texture.y, texture.width, texture.height, m_gutter);
+		}
+		return;
+	}
+
+	const uint32_t* image = m_source->getPixels(textureID);
+	if (!image)
+	{
+		return;
+	}
+
+	const uint32_t* stored = image + (size_t)texture.trimY * texture.sourceWidth + texture.trimX;
+	m_pixels->blit(texture.layer, texture.x, texture.y, texture.width, texture.height, stored, texture.sourceWidth);
+	m_pixels->extrude(texture.layer, texture.x, texture.y, texture.width, texture.height, m_gutter);
+}
+
+// With trimming on, the opaque bounds of the image; a fully transparent image keeps its
+// top left pixel so it still gets a rect. Sources without pixels are never trimmed.
+bool PackedAtlas::measure (const unsigned long textureID, Footprint& footprint)
+{
+	if (m_hasMeasured && m_measuredTexture == textureID)
+	{
+		footprint = m_measured;
+		return true;
+	}
+
+	unsigned int width, height;
+	if (!m_source->getSize(textureID, width, height))
+	{
+		return false;
+	}
+
+	const Footprint whole = { width, height, 0, 0, width, height };
+	footprint = whole;
+	if (m_trim && width && height)
+	{
+		const uint32_t* image = m_source->getPixels(textureID);
+		if (image && !AtlasPixels::opaqueBounds(image, width, height, footprint.trimX, footprint.trimY, footprint.width, footprint.height))
+		{
+			footprint.width = 1;
+			footprint.height = 1;
+		}
+		m_measuredTexture = textureID;
+		m_measured = footprint;
+		m_hasMeasured = true;
+	}
+	return true;
+}
+
+// The image deduplication compares: blocks with a block store, otherwise pixels.
+const void* PackedAtlas::content (const unsigned long textureID, const unsigned int width, const unsigned int height, size_t& bytes) const
+{
+	if (m_blocks)
+	{
+		bytes = (size_t)((width + m_blockSize - 1) / m_blockSize) * ((height + m_blockSize - 1) / m_blockSize) * m_blocks->bytesPerBlock();
+		return m_source->getBlocks(textureID);
+	}
+
+	bytes = (size_t)width * height * 4;
+	return m_source->getPixels(textureID);
+}
+
+// Hashes the texture's blocks when the atlas keeps a block store and its pixels otherwise.
+// The size is part of the seed, so equal bytes at different sizes do not match.
+bool PackedAtlas::hashContent (const unsigned long textureID, const unsigned int width, const unsigned int height, uint64_t& hash)
+{
+	if (m_hashed && m_hashedTexture == textureID)
+	{
+		hash = m_hashedContent;
+		return true;
+	}
+
+	size_t bytes;
+	const void* payload = content(textureID, width, height, bytes);
+	if (!payload)
+	{
+		return false;
+	}
+
+	hash = contentHash(payload, bytes, ((uint64_t)width << 32) | height);
+	m_hashedTexture = textureID;
+	m_hashedContent = hash;
+	m_hashed = true;
+	return true;
+}
+
+// The placed texture with the same image, if any. Leaves the hash in m_hashedContent.
+const AtlasedTexture* PackedAtlas::findDuplicate (const unsigned long textureID)
+{
+	unsigned int width, height;
+	uint64_t hash;
+	if (!m_deduplicate || !m_source->getSize(textureID, width, height) || !hashContent(textureID, width, height, hash))
+	{
+		return NULL;
+	}
+
+	std::map<uint64_t, unsigned long>::const_iterator owner = m_contentOwners.find(hash);
+	if (owner == m_contentOwners.end())
+	{
+		return NULL;
+	}
+
+	std::map<unsigned long, AtlasedTexture>::const_iterator texture = m_textures.find(owner->second);
+	if (texture == m_textures.end() || texture->second.sourceWidth != width || texture->second.sourceHeight != height)
+	{
+		return NULL;
+	}
+
+	// Equal hashes only make a duplicate likely; the bytes decide.
+	size_t bytes;
+	const void* candidate = content(textureID, width, height, bytes);
+	const void* original = content(owner->second, width, height, bytes);
+	return (candidate && original && memcmp(candidate, original, bytes) == 0) ? &texture->second : NULL;
+}
+
+void PackedAtlas::syncAliases()
+{
+	for (std::map<unsigned long, unsigned long>::const_iterator it = m_aliasOwners.begin(); it != m_aliasOwners.end(); ++it)
+	{
+		m_textures[it->first] = m_textures[it->second];
+	}
+}
+
+// The owner of a region is being removed. If duplicates still use the region, one of them
+// becomes its owner and true is returned; otherwise the hash is forgotten and the caller
+// frees the region.
+bool PackedAtlas::handOverRegion (const unsigned long owner)
+{
+	const uint64_t hash = m_ownerHashes[owner];
+	m_ownerHashes.erase(owner);
+
+	unsigned long heir = 0;
+	bool found = false;
+	for (std::map<unsigned long, unsigned long>::iterator it = m_aliasOwners.begin(); it != m_aliasOwners.end(); ++it)
+	{
+		if (it->second != owner)
+		{
+			continue;
+		}
+		if (!found)
+		{
+			heir = it->first;
+			found = true;
+		}
+		it->second = heir;
+	}
+
+	if (!found)
+	{
+		m_contentOwners.erase(hash);
+		return false;
+	}
+
+	m_aliasOwners.erase(heir);
+	m_contentOwners[hash] = heir;
+	m_ownerHashes[heir] = hash;
+	return true;
+}
+
+#endif
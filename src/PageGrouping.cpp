@@ -0,0 +1,268 @@
+#ifndef PAGE_GROUPING_CPP
+#define PAGE_GROUPING_CPP
+
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <stddef.h>
+#include "PackedAtlas.cpp"
+#include "CooccurrenceRecorder.cpp"
+
+// A texture to group, with the size it takes on a page (gutters and block rounding included).
+struct GroupedTexture {
+	unsigned long textureID;
+	unsigned int width;
+	unsigned int height;
+};
+
+// Offline assignment of textures to atlas pages from recorded co-occurrence, so textures a
+// batch key draws together share a page and its catalogue does not fill up early. Every
+// texture starts as its own cluster; pairs are visited most frequent first and their
+// clusters merged while the union still packs into one page. Clusters then go to pages
+// largest first, first fit. The result is meant for PackedAtlas::setPageHint().
+class PageGrouping {
+public:
+	// The prototype is only used to create pages; it is not modified.
+	inline PageGrouping(const RectPacker& prototype, const size_t pageLimit) : m_prototype(prototype), m_pageLimit(pageLimit ? pageLimit : 1) {};
+
+	// False if the textures do not fit in pageLimit pages.
+	bool assign (const std::vector<GroupedTexture>& textures, const CooccurrenceRecorder& statistics, std::map<unsigned long, unsigned int>& pages) const;
+	// The layout a plain PackedAtlas would make, tallest first, for comparison.
+	bool assignFirstFit (const std::vector<GroupedTexture>& textures, std::map<unsigned long, unsigned int>& pages) const;
+
+	// Recorded pair counts whose textures ended up on different pages, each one a frame in
+	// which a batch key's textures were split. Pairs with an unassigned texture are skipped.
+	static unsigned long long splitWeight (const CooccurrenceRecorder& statistics, const std::map<unsigned long, unsigned int>& pages);
+
+private:
+	typedef std::pair<unsigned long long, CooccurrenceRecorder::TexturePair> WeightedPair;
+	typedef std::pair<unsigned long long, size_t> ClusterArea;
+
+	const RectPacker& m_prototype;
+	const size_t m_pageLimit;
+
+	bool packs (const std::vector<GroupedTexture>& textures) const;
+	bool placeFirstFit (std::vector<RectPacker*>& pages, const std::vector<GroupedTexture>& textures, unsigned int& page) const;
+
+	static bool isTaller (const GroupedTexture& left, const GroupedTexture& right);
+	static bool isHeavier (const WeightedPair& left, const WeightedPair& right);
+	static bool isLarger (const ClusterArea& left, const ClusterArea& right);
+	static unsigned long long area (const std::vector<GroupedTexture>& textures);
+	static void deletePages (std::vector<RectPacker*>& pages);
+
+	PageGrouping(const PageGrouping&);
+	PageGrouping& operator=(const PageGrouping&);
+};
+
+bool PageGrouping::assign (const std::vector<GroupedTexture>& textures, const CooccurrenceRecorder& statistics, std::map<unsigned long, unsigned int>& pages) const
+{
+	std::map<unsigned long, size_t> clusterOf;
+	std::vector<std::vector<GroupedTexture> > clusters(textures.size());
+	for (size_t i = 0; i < textures.size(); ++i)
+	{
+		clusterOf[textures[i].textureID] = i;
+		clusters[i].push_back(textures[i]);
+	}
+
+	std::vector<WeightedPair> weighted;
+	const std::map<CooccurrenceRecorder::TexturePair, unsigned long long>& pairs = statistics.pairs();
+	for (std::map<CooccurrenceRecorder::TexturePair, unsigned long long>::const_iterator pair = pairs.begin(); pair != pairs.end(); ++pair)
+	{
+		if (clusterOf.count(pair->first.first) && clusterOf.count(pair->first.second))
+		{
+			weighted.push_back(WeightedPair(pair->second, pair->first));
+		}
+	}
+	std::stable_sort(weighted.begin(), weighted.end(), isHeavier);
+
+	const unsigned long long pageArea = (unsigned long long)m_prototype.width() * m_prototype.height();
+	for (size_t i = 0; i < weighted.size(); ++i)
+	{
+		const size_t into = clusterOf[weighted[i].second.first];
+		const size_t from = clusterOf[weighted[i].second.second];
+		if (into == from || area(clusters[into]) + area(clusters[from]) > pageArea)
+		{
+			continue;
+		}
+
+		std::vector<GroupedTexture> merged(clusters[into]);
+		merged.insert(merged.end(), clusters[from].begin(), clusters[from].end());
+		if (!packs(merged))
+		{
+			continue;
+		}
+
+		for (size_t j = 0; j < clusters[from].size(); ++j)
+		{
+			clusterOf[clusters[from][j].textureID] = into;
+		}
+		clusters[into].swap(merged);
+		clusters[from].clear();
+	}
+
+	std::vector<ClusterArea> order;
+	for (size_t i = 0; i < clusters.size(); ++i)
+	{
+		if (!clusters[i].empty())
+		{
+			order.push_back(ClusterArea(area(clusters[i]), i));
+		}
+	}
+	std::stable_sort(order.begin(), order.end(), isLarger);
+
+	std::vector<RectPacker*> packers;
+	bool placed = true;
+	for (size_t i = 0; i < order.size() && placed; ++i)
+	{
+		std::vector<GroupedTexture>& cluster = clusters[order[i].second];
+		std::sort(cluster.begin(), cluster.end(), isTaller);
+		unsigned int page;
+		if (placeFirstFit(packers, cluster, page))
+		{
+			for (size_t j = 0; j < cluster.size(); ++j)
+			{
+				pages[cluster[j].textureID] = page;
+			}
+			continue;
+		}
+
+		// No page has room for the whole cluster any more: spread it texture by texture.
+		for (size_t j = 0; j < cluster.size() && placed; ++j)
+		{
+			placed = placeFirstFit(packers, std::vector<GroupedTexture>(1, cluster[j]), page);
+			if (placed)
+			{
+				pages[cluster[j].textureID] = page;
+			}
+		}
+	}
+
+	deletePages(packers);
+	return placed;
+}
+
+bool PageGrouping::assignFirstFit (const std::vector<GroupedTexture>& textures, std::map<unsigned long, unsigned int>& pages) const
+{
+	std::vector<GroupedTexture> sorted(textures);
+	std::stable_sort(sorted.begin(), sorted.end(), isTaller);
+
+	std::vector<RectPacker*> packers;
+	bool placed = true;
+	for (size_t i = 0; i < sorted.size() && placed; ++i)
+	{
+		unsigned int page;
+		placed = placeFirstFit(packers, std::vector<GroupedTexture>(1, sorted[i]), page);
+		if (placed)
+		{
+			pages[sorted[i].textureID] = page;
+		}
+	}
+
+	deletePages(packers);
+	return placed;
+}
+
+unsigned long long PageGrouping::splitWeight (const CooccurrenceRecorder& statistics, const std::map<unsigned long, unsigned int>& pages)
+{
+	unsigned long long split = 0;
+	const std::map<CooccurrenceRecorder::TexturePair, unsigned long long>& pairs = statistics.pairs();
+	for (std::map<CooccurrenceRecorder::TexturePair, unsigned long long>::const_iterator pair = pairs.begin(); pair != pairs.end(); ++pair)
+	{
+		std::map<unsigned long, unsigned int>::const_iterator first = pages.find(pair->first.first);
+		std::map<unsigned long, unsigned int>::const_iterator second = pages.find(pair->first.second);
+		if (first != pages.end() && second != pages.end() && first->second != second->second)
+		{
+			split += pair->second;
+		}
+	}
+	return split;
+}
+
+// Packs the textures, tallest first, into an empty page.
+bool PageGrouping::packs (const std::vector<GroupedTexture>& textures) const
+{
+	std::vector<GroupedTexture> sorted(textures);
+	std::sort(sorted.begin(), sorted.end(), isTaller);
+
+	RectPacker* page = m_prototype.createPage();
+	bool fits = true;
+	AtlasRect rect;
+	for (size_t i = 0; i < sorted.size() && fits; ++i)
+	{
+		fits = page->insert(sorted[i].width, sorted[i].height, rect);
+	}
+	delete page;
+	return fits;
+}
+
+// All of the textures go on the first page with room for them, or on a new page.
+bool PageGrouping::placeFirstFit (std::vector<RectPacker*>& pages, const std::vector<GroupedTexture>& textures, unsigned int& page) const
+{
+	AtlasRect rect;
+	for (page = 0; page <= pages.size() && page < m_pageLimit; ++page)
+	{
+		const bool fresh = page == pages.size();
+		if (fresh)
+		{
+			pages.push_back(m_prototype.createPage());
+		}
+
+		pages[page]->saveState();
+		bool fits = true;
+		for (size_t i = 0; i < textures.size() && fits; ++i)
+		{
+			fits = pages[page]->insert(textures[i].width, textures[i].height, rect);
+		}
+		if (fits)
+		{
+			return true;
+		}
+		pages[page]->restoreState();
+		if (fresh)
+		{
+			// Not even an empty page takes them.
+			break;
+		}
+	}
+	return false;
+}
+
+bool PageGrouping::isTaller (const GroupedTexture& left, const GroupedTexture& right)
+{
+	if (left.height != right.height)
+	{
+		return left.height > right.height;
+	}
+	return left.width > right.width;
+}
+
+bool PageGrouping::isHeavier (const WeightedPair& left, const WeightedPair& right)
+{
+	return left.first > right.first;
+}
+
+bool PageGrouping::isLarger (const ClusterArea& left, const ClusterArea& right)
+{
+	return left.first > right.first;
+}
+
+unsigned long long PageGrouping::area (const std::vector<GroupedTexture>& textures)
+{
+	unsigned long long total = 0;
+	for (size_t i = 0; i < textures.size(); ++i)
+	{
+		total += (unsigned long long)textures[i].width * textures[i].height;
+	}
+	return total;
+}
+
+void PageGrouping::deletePages (std::vector<RectPacker*>& pages)
+{
+	for (size_t i = 0; i < pages.size(); ++i)
+	{
+		delete pages[i];
+	}
+	pages.clear();
+}
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef PARALLEL_CATALOGUE_BUILDER_CPP
+#define PARALLEL_CATALOGUE_BUILDER_CPP
+
+#include <functional>
+#include <map>
+#include <vector>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "BatchCatalogueRegistry.cpp"
+
+// Builds a frame's catalogues on several threads. The descriptors are split into contiguous
+// partitions and each worker groups its partition by eligibility and collects the distinct
+// primary textures of each group in first-seen order. Workers touch no shared state: not the
+// shader program table, the texture registry or any atlas.
+//
+// The merge runs on the calling thread. Groups with equal keys are combined in global
+// first-seen order, and their textures are placed through the registry, which re-checks
+// atlas fit. Placement order therefore depends only on the input order, so the catalogues
+// are identical for any thread count.
+class ParallelCatalogueBuilder {
+public:
+	inline ParallelCatalogueBuilder(BatchCatalogueRegistry& registry, const size_t threads) :
+		m_registry(registry),
+		m_threads(threads ? threads : 1)
+	{};
+
+	size_t build (const BatchDescriptor* descriptors, const size_t count, BatchCatalogue** assignments);
+
+private:
+	struct GroupTuple {
+		unsigned long format;
+		bool isStatic;
+		const ShaderObject* vShader;
+		const ShaderObject* fShader;
+		bool indicies;
+
+		bool operator< (const GroupTuple& other) const;
+		bool operator== (const GroupTuple& other) const;
+	};
+
+	// Open-addressing map from (group, primary texture id) to the texture's slot in that
+	// group. One table serves every group of a partition, or of the merge, so looking up an
+	// object's texture is a hash and a probe rather than a tree walk.
+	class SlotTable {
+	public:
+		inline SlotTable() : m_size(0) { Entry empty = { kEmpty, 0 }; m_entries.assign(kInitialSlots, empty); };
+
+		uint32_t slotFor (const uint32_t group, const unsigned int textureId, const uint32_t nextSlot);
+
+	private:
+		struct Entry {
+			uint64_t key;
+			uint32_t slot;
+		};
+
+		std::vector<Entry> m_entries;
+		size_t m_size;
+
+		void grow();
+
+		static size_t hash (const uint64_t key);
+		static const uint64_t kEmpty = ~0ULL;
+		static const size_t kInitialSlots = 256;
+	};
+
+	struct LocalGroup {
+		std::vector<uint32_t> firstUses;
+	};
+
+	struct Partition {
+		const BatchDescriptor* descriptors;
+		size_t begin;
+		size_t end;
+		std::vector<LocalGroup> groups;
+		SlotTable slots;
+		std::vector<uint32_t> objectGroups;
+		std::vector<uint32_t> objectSlots;
+	};
+
+	struct GlobalGroup {
+		BatchKey key;
+		std::vector<uint32_t> firstUses;
+		std::vector<BatchCatalogue*> catalogues;
+	};
+
+	BatchCatalogueRegistry& m_registry;
+	const size_t m_threads;
+
+	static void* work (void* partition);
+	static void group (Partition& partition);
+	static GroupTuple tupleFor (const BatchDescriptor& descriptor);
+
+	ParallelCatalogueBuilder(const ParallelCatalogueBuilder&);
+	ParallelCatalogueBuilder& operator=(const ParallelCatalogueBuilder&);
+};
+
+// assignments[i] receives the catalogue for descriptors[i], or NULL when even a fresh
+// catalogue could not take it. Returns the number of objects assigned.
+size_t ParallelCatalogueBuilder::build (const BatchDescriptor* descriptors, const size_t count, BatchCatalogue** assignments)
+{
+	const size_t partitionCount = (count < m_threads) ? (count ? count : 1) : m_threads;
+	std::vector<Partition> partitions(partitionCount);
+	for (size_t p = 0; p < partitionCount; ++p)
+	{
+		partitions[p].descriptors = descriptors;
+		partitions[p].begin = count * p / partitionCount;
+		partitions[p].end = count * (p + 1) / partitionCount;
+	}
+
+	std::vector<pthread_t> workers(partitionCount);
+	std::vector<bool> started(partitionCount, false);
+	for (size_t p = 1; p < partitionCount; ++p)
+	{
+		started[p] = pthread_create(&workers[p], NULL, work, &partitions[p]) == 0;
+	}
+	group(partitions[0]);
+	for (size_t p = 1; p < partitionCount; ++p)
+	{
+		if (started[p])
+		{
+			pthread_join(workers[p], NULL);
+		}
+		else
+		{
+			group(partitions[p]);
+		}
+	}
+
+	std::vector<GlobalGroup> globalGroups;
+	std::map<uint64_t, uint32_t> globalIndex;
+	SlotTable globalSlots;
+	std::vector<std::vector<uint32_t> > localToGlobal(partitionCount);
+	std::vector<std::vector<std::vector<uint32_t> > > localToGlobalSlot(partitionCount);
+	for (size_t p = 0; p < partitionCount; ++p)
+	{
+		const Partition& partition = partitions[p];
+		localToGlobal[p].resize(partition.groups.size());
+		localToGlobalSlot[p].resize(partition.groups.size());
+
+		for (size_t g = 0; g < partition.groups.size(); ++g)
+		{
+			const LocalGroup& local = partition.groups[g];
+			BatchKey key = BatchKey::forNewCatalogue(descriptors[local.firstUses[0]]);
+
+			std::map<uint64_t, uint32_t>::iterator found = globalIndex.find(key.value());
+			if (found == globalIndex.end())
+			{
+				found = globalIndex.insert(std::make_pair(key.value(), (uint32_t)globalGroups.size())).first;
+				globalGroups.push_back(GlobalGroup());
+				globalGroups.back().key = key;
+			}
+			localToGlobal[p][g] = found->second;
+
+			GlobalGroup& global = globalGroups[found->second];
+			for (size_t s = 0; s < local.firstUses.size(); ++s)
+			{
+				const unsigned int textureId = descriptors[local.firstUses[s]].textureIds[0];
+				const uint32_t nextSlot = (uint32_t)global.firstUses.size();
+				const uint32_t slot = globalSlots.slotFor(found->second, textureId, nextSlot);
+				if (slot == nextSlot)
+				{
+					global.firstUses.push_back(local.firstUses[s]);
+				}
+				localToGlobalSlot[p][g].push_back(slot);
+			}
+		}
+	}
+
+	for (size_t g = 0; g < globalGroups.size(); ++g)
+	{
+		GlobalGroup& global = globalGroups[g];
+		global.catalogues.resize(global.firstUses.size());
+		for (size_t s = 0; s < global.firstUses.size(); ++s)
+		{
+			global.catalogues[s] = m_registry.catalogueFor(descriptors[global.firstUses[s]], global.key);
+		}
+	}
+
+	size_t assigned = 0;
+	for (size_t p = 0; p < partitionCount; ++p)
+	{
+		const Partition& partition = partitions[p];
+		for (size_t i = partition.begin; i < partition.end; ++i)
+		{
+			const uint32_t localGroup = partition.objectGroups[i - partition.begin];
+			const uint32_t localSlot = partition.objectSlots[i - partition.begin];
+			assignments[i] = globalGroups[localToGlobal[p][localGroup]].catalogues[localToGlobalSlot[p][localGroup][localSlot]];
+			if (assignments[i])
+			{
+				++assigned;
+			}
+		}
+	}
+
+	return assigned;
+}
+
+void* ParallelCatalogueBuilder::work (void* partition)
+{
+	group(*static_cast<Partition*>(partition));
+	return NULL;
+}
+
+void ParallelCatalogueBuilder::group (Partition& partition)
+{
+	std::map<GroupTuple, uint32_t> groupIndex;
+	GroupTuple lastTuple = GroupTuple();
+	uint32_t lastGroup = 0;
+	bool haveLast = false;
+
+	partition.objectGroups.resize(partition.end - partition.begin);
+	partition.objectSlots.resize(partition.end - partition.begin);
+
+	for (size_t i = partition.begin; i < partition.end; ++i)
+	{
+		const BatchDescriptor& descriptor = partition.descriptors[i];
+		const GroupTuple tuple = tupleFor(descriptor);
+
+		if (!haveLast || !(tuple == lastTuple))
+		{
+			std::map<GroupTuple, uint32_t>::iterator found = groupIndex.find(tuple);
+			if (found == groupIndex.end())
+			{
+				found = groupIndex.insert(std::make_pair(tuple, (uint32_t)partition.groups.size())).first;
+				partition.groups.push_back(LocalGroup());
+			}
+			lastTuple = tuple;
+			lastGroup = found->second;
+			haveLast = true;
+		}
+
+		LocalGroup& local = partition.groups[lastGroup];
+		const uint32_t nextSlot = (uint32_t)local.firstUses.size();
+		const uint32_t slot = partition.slots.slotFor(lastGroup, descriptor.textureIds[0], nextSlot);
+		if (slot == nextSlot)
+		{
+			local.firstUses.push_back((uint32_t)i);
+		}
+
+		partition.objectGroups[i - partition.begin] = lastGroup;
+		partition.objectSlots[i - partition.begin] = slot;
+	}
+}
+
+ParallelCatalogueBuilder::GroupTuple ParallelCatalogueBuilder::tupleFor (const BatchDescriptor& descriptor)
+{
+	GroupTuple tuple = { descriptor.format, descriptor.isStatic, descriptor.vShader, descriptor.fShader, descriptor.indicies };
+	return tuple;
+}
+
+// The slot already given to textureId in group, or nextSlot, which is recorded for it, when
+// the group has not seen it.
+uint32_t ParallelCatalogueBuilder::SlotTable::slotFor (const uint32_t group, const unsigned int textureId, const uint32_t nextSlot)
+{
+	const uint64_t key = ((uint64_t)group << 32) | textureId;
+	const size_t mask = m_entries.size() - 1;
+	size_t index = hash(key) & mask;
+	while (m_entries[index].key != kEmpty)
+	{
+		if (m_entries[index].key == key)
+		{
+			return m_entries[index].slot;
+		}
+		index = (index + 1) & mask;
+	}
+
+	m_entries[index].key = key;
+	m_entries[index].slot = nextSlot;
+	if (++m_size * 2 > m_entries.size())
+	{
+		grow();
+	}
+	return nextSlot;
+}
+
+void ParallelCatalogueBuilder::SlotTable::grow()
+{
+	std::vector<Entry> old;
+	old.swap(m_entries);
+
+	Entry empty = { kEmpty, 0 };
+	m_entries.assign(old.size() * 2, empty);
+
+	const size_t mask = m_entries.size() - 1;
+	for (size_t i = 0; i < old.size(); ++i)
+	{
+		if (old[i].key == kEmpty)
+		{
+			continue;
+		}
+		size_t index = hash(old[i].key) & mask;
+		while (m_entries[index].key != kEmpty)
+		{
+			index = (index + 1) & mask;
+		}
+		m_entries[index] = old[i];
+	}
+}
+
+size_t ParallelCatalogueBuilder::SlotTable::hash (const uint64_t key)
+{
+	uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+	h ^= h >> 29;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 32;
+	return (size_t)h;
+}
+
+bool ParallelCatalogueBuilder::GroupTuple::operator< (const GroupTuple& other) const
+{
+	if (format != other.format) { return format < other.format; }
+	if (isStatic != other.isStatic) { return isStatic < other.isStatic; }
+	if (vShader != other.vShader) { return std::less<const ShaderObject*>()(vShader, other.vShader); }
+	if (fShader != other.fShader) { return std::less<const ShaderObject*>()(fShader, other.fShader); }
+	return indicies < other.indicies;
+}
+
+bool ParallelCatalogueBuilder::GroupTuple::operator== (const GroupTuple& other) const
+{
+	return format == other.format && isStatic == other.isStatic && vShader == other.vShader && fShader == other.fShader && indicies == other.indicies;
+}
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef SHADER_PROGRAM_TABLE_CPP
+#define SHADER_PROGRAM_TABLE_CPP
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "min_deps.cpp"
+
+// Interns (vertex shader, fragment shader) pairs into 16-bit program ids. Program 0 is
+// always (NULL, NULL); the others are numbered in first-seen order and never reused. Once
+// kMaxPrograms pairs are known, new pairs get kNoProgram, which BatchKey makes unbatchable.
+// find() never inserts, so lookups for pairs no catalogue uses cannot use up the ids.
+class ShaderProgramTable {
+public:
+	ShaderProgramTable();
+
+	static ShaderProgramTable& shared();
+
+	unsigned short intern (const ShaderObject* vShader, const ShaderObject* fShader);
+	unsigned short find (const ShaderObject* vShader, const ShaderObject* fShader) const;
+	inline const ShaderObject* vertexShader (const unsigned short programId) const { return programId < m_programs.size() ? m_programs[programId].vShader : NULL; };
+	inline const ShaderObject* fragmentShader (const unsigned short programId) const { return programId < m_programs.size() ? m_programs[programId].fShader : NULL; };
+	inline size_t size() const { return m_programs.size(); };
+
+	static const unsigned short kNoProgram = 0xFFFF;
+	static const size_t kMaxPrograms = kNoProgram;
+
+private:
+	struct Program {
+		const ShaderObject* vShader;
+		const ShaderObject* fShader;
+	};
+
+	std::vector<Program> m_programs;
+	std::vector<int> m_index;
+
+	size_t slotFor (const ShaderObject* vShader, const ShaderObject* fShader) const;
+	void grow();
+
+	static size_t hash (const ShaderObject* vShader, const ShaderObject* fShader);
+	static const size_t kInitialSlots = 64;
+};
+
+const unsigned short ShaderProgramTable::kNoProgram;
+const size_t ShaderProgramTable::kMaxPrograms;
+
+ShaderProgramTable::ShaderProgramTable() :
+	m_index(kInitialSlots, -1)
+{
+	intern(NULL, NULL);
+}
+
+ShaderProgramTable& ShaderProgramTable::shared()
+{
+	static ShaderProgramTable table;
+	return table;
+}
+
+unsigned short ShaderProgramTable::intern (const ShaderObject* vShader, const ShaderObject* fShader)
+{
+	size_t slot = slotFor(vShader, fShader);
+	if (m_index[slot] >= 0)
+	{
+		return (unsigned short)m_index[slot];
+	}
+	if (m_programs.size() >= kMaxPrograms)
+	{
+		return kNoProgram;
+	}
+
+	Program program = { vShader, fShader };
+	m_index[slot] = (int)m_programs.size();
+	m_programs.push_back(program);
+
+	if (m_programs.size() * 2 > m_index.size())
+	{
+		grow();
+	}
+
+	return (unsigned short)(m_programs.size() - 1);
+}
+
+// kNoProgram when the pair has not been interned.
+unsigned short ShaderProgramTable::find (const ShaderObject* vShader, const ShaderObject* fShader) const
+{
+	const int program = m_index[slotFor(vShader, fShader)];
+	return program >= 0 ? (unsigned short)program : kNoProgram;
+}
+
+size_t ShaderProgramTable::slotFor (const ShaderObject* vShader, const ShaderObject* fShader) const
+{
+	const size_t mask = m_index.size() - 1;
+	size_t slot = hash(vShader, fShader) & mask;
+	while (m_index[slot] >= 0)
+	{
+		const Program& program = m_programs[m_index[slot]];
+		if (program.vShader == vShader && program.fShader == fShader)
+		{
+			break;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+void ShaderProgramTable::grow()
+{
+	m_index.assign(m_index.size() * 2, -1);
+
+	const size_t mask = m_index.size() - 1;
+	for (size_t i = 0; i < m_programs.size(); ++i)
+	{
+		size_t slot = hash(m_programs[i].vShader, m_programs[i].fShader) & mask;
+		while (m_index[slot] >= 0)
+		{
+			slot = (slot + 1) & mask;
+		}
+		m_index[slot] = (int)i;
+	}
+}
+
+size_t ShaderProgramTable::hash (const ShaderObject* vShader, const ShaderObject* fShader)
+{
+	uint64_t h = (uint64_t)(uintptr_t)vShader * 0x9E3779B97F4A7C15ULL;
+	h ^= (uint64_t)(uintptr_t)fShader + 0x7F4A7C159E3779B9ULL + (h << 6) + (h >> 2);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t)h;
+}
+
+#endif
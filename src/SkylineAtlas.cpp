@@ -0,0 +1,187 @@
+#ifndef SKYLINE_ATLAS_CPP
+#define SKYLINE_ATLAS_CPP
+
+#include <vector>
+#include <stddef.h>
+#include "PackedAtlas.cpp"
+
+// Bottom-left skyline packer. The skyline is kept as left-to-right segments; a fit scan slides
+// a window over them with a monotonic queue of segment heights, so fits() and the position
+// search in insert() are O(segments) whatever the texture width.
+class SkylinePacker : public RectPacker {
+public:
+	SkylinePacker(const unsigned int width, const unsigned int height);
+
+	bool fits (const unsigned int width, const unsigned int height) const;
+	bool insert (const unsigned int width, const unsigned int height, AtlasRect& placed);
+	void clear();
+	void saveState();
+	void restoreState();
+	RectPacker* createPage() const;
+
+	inline size_t segmentCount() const { return m_segments.size(); };
+
+private:
+	struct Segment {
+		unsigned int x;
+		unsigned int y;
+		unsigned int width;
+	};
+
+	std::vector<Segment> m_segments;
+	std::vector<Segment> m_savedSegments;
+	mutable std::vector<size_t> m_window;
+
+	bool findPosition (const unsigned int width, const unsigned int height, const bool firstFit, size_t& index, unsigned int& y) const;
+};
+
+class SkylineAtlas : public PackedAtlas {
+public:
+	inline SkylineAtlas(TextureSource* source, const unsigned int width, const unsigned int height, const size_t pageLimit = 1) :
+		PackedAtlas(source, new SkylinePacker(width, height), pageLimit)
+	{};
+};
+
+SkylinePacker::SkylinePacker(const unsigned int width, const unsigned int height) :
+	RectPacker(width, height)
+{
+	m_segments.reserve(64);
+	m_window.reserve(64);
+	clear();
+}
+
+void SkylinePacker::clear()
+{
+	m_segments.clear();
+	Segment floor = { 0, 0, m_width };
+	m_segments.push_back(floor);
+}
+
+void SkylinePacker::saveState()
+{
+	m_savedSegments = m_segments;
+}
+
+void SkylinePacker::restoreState()
+{
+	m_segments = m_savedSegments;
+}
+
+RectPacker* SkylinePacker::createPage() const
+{
+	return new SkylinePacker(m_width, m_height);
+}
+
+bool SkylinePacker::fits (const unsigned int width, const unsigned int height) const
+{
+	size_t index;
+	unsigned int y;
+	return findPosition(width, height, true, index, y);
+}
+
+bool SkylinePacker::insert (const unsigned int width, const unsigned int height, AtlasRect& placed)
+{
+	size_t index;
+	unsigned int y;
+	if (!findPosition(width, height, false, index, y))
+	{
+		return false;
+	}
+
+	placed.x = m_segments[index].x;
+	placed.y = y;
+	placed.width = width;
+	placed.height = height;
+	if (width == 0 || height == 0)
+	{
+		return true;
+	}
+
+	const unsigned int right = placed.x + width;
+	size_t covered = index;
+	while (covered < m_segments.size() && m_segments[covered].x + m_segments[covered].width <= right)
+	{
+		++covered;
+	}
+	if (covered < m_segments.size() && m_segments[covered].x < right)
+	{
+		m_segments[covered].width -= right - m_segments[covered].x;
+		m_segments[covered].x = right;
+	}
+
+	Segment top = { placed.x, y + height, width };
+	m_segments.erase(m_segments.begin() + index, m_segments.begin() + covered);
+	m_segments.insert(m_segments.begin() + index, top);
+
+	if (index + 1 < m_segments.size() && m_segments[index + 1].y == top.y)
+	{
+		m_segments[index].width += m_segments[index + 1].width;
+		m_segments.erase(m_segments.begin() + index + 1);
+	}
+	if (index > 0 && m_segments[index - 1].y == top.y)
+	{
+		m_segments[index - 1].width += m_segments[index].width;
+		m_segments.erase(m_segments.begin() + index);
+	}
+
+	return true;
+}
+
+// Picks the lowest resulting top edge, leftmost on ties. firstFit stops at any position.
+bool SkylinePacker::findPosition (const unsigned int width, const unsigned int height, const bool firstFit, size_t& index, unsigned int& y) const
+{
+	if (width > m_width || height > m_height)
+	{
+		return false;
+	}
+	if (width == 0 || height == 0)
+	{
+		index = 0;
+		y = 0;
+		return true;
+	}
+
+	bool found = false;
+	size_t head = 0;
+	size_t end = 0;
+	m_window.clear();
+
+	for (size_t i = 0; i < m_segments.size(); ++i)
+	{
+		const unsigned int right = m_segments[i].x + width;
+		if (right > m_width)
+		{
+			break;
+		}
+
+		while (end < m_segments.size() && m_segments[end].x < right)
+		{
+			while (m_window.size() > head && m_segments[m_window.back()].y <= m_segments[end].y)
+			{
+				m_window.pop_back();
+			}
+			m_window.push_back(end);
+			++end;
+		}
+		while (m_window[head] < i)
+		{
+			++head;
+		}
+
+		const unsigned int base = m_segments[m_window[head]].y;
+		if (base + height <= m_height && (!found || base < y))
+		{
+			found = true;
+			index = i;
+			y = base;
+			if (firstFit)
+			{
+				return true;
+			}
+		}
+	}
+
+	return found;
+}
+
+#endif
@@ -0,0 +1,358 @@
+#ifndef SLAB_ATLAS_CPP
+#define SLAB_ATLAS_CPP
+
+#include <map>
+#include <vector>
+#include <stddef.h>
+#include "PackedAtlas.cpp"
+
+// TextureManager::Atlas for dynamic textures that come in a few fixed sizes. The page is
+// split into square slabs; a slab is given to a size class the first time that class runs
+// out of cells and carved into cells of the class size, and goes back to the free slabs once
+// none of its cells is in use. Each class keeps a free list of cells, so allocating and
+// removing are a pop and a push, and churn never fragments the page, not even across
+// classes. A texture goes in the smallest class (by cell area) it fits.
+class SlabAtlas : public TextureManager::Atlas {
+public:
+	SlabAtlas(TextureSource* source, const unsigned int width, const unsigned int height, const unsigned int slabSize);
+
+	// Classes must be added before the first texture or reservation, as both refer to their
+	// class by position; cells larger than a slab are ignored.
+	bool addSizeClass (const unsigned int cellWidth, const unsigned int cellHeight);
+
+	bool willFit (const unsigned long textureID);
+	const AtlasedTexture* addTexture (const unsigned long textureID);
+	const AtlasedTexture* find (const unsigned long textureID) const;
+	bool removeTexture (const unsigned long textureID);
+	bool fitsWithout (const unsigned long textureID, const std::vector<unsigned long>& removed);
+
+	bool reserve (const unsigned long textureID);
+	const AtlasedTexture* commit (const unsigned long textureID);
+	void rollback (const unsigned long textureID);
+
+	inline size_t textureCount() const { return m_textures.size(); };
+	inline size_t freeSlabCount() const { return m_freeSlabs.size(); };
+	inline size_t sizeClassCount() const { return m_classes.size(); };
+
+private:
+	struct Cell {
+		unsigned int x;
+		unsigned int y;
+	};
+
+	struct SizeClass {
+		unsigned int width;
+		unsigned int height;
+		std::vector<Cell> freeCells;
+	};
+
+	struct Slot {
+		AtlasedTexture texture;
+		size_t sizeClass;
+		Cell cell;
+	};
+
+	struct Reservation {
+		unsigned long textureID;
+		size_t sizeClass;
+		Cell cell;
+		unsigned int width;
+		unsigned int height;
+	};
+
+	TextureSource* m_source;
+	const unsigned int m_width;
+	const unsigned int m_height;
+	const unsigned int m_slabSize;
+	std::vector<SizeClass> m_classes;
+	std::vector<Cell> m_freeSlabs;
+	// Cells in use or reserved per slab, in row order.
+	std::vector<unsigned int> m_slabUse;
+	unsigned int m_slabColumns;
+	std::vector<Reservation> m_reservations;
+	std::map<unsigned long, Slot> m_textures;
+
+	bool classFor (const unsigned long textureID, size_t& sizeClass, unsigned int& width, unsigned int& height);
+	bool hasCell (const size_t sizeClass) const;
+	Cell takeCell (const size_t sizeClass);
+	void freeCell (const size_t sizeClass, const Cell& cell);
+	inline size_t slabOf (const Cell& cell) const { return (size_t)(cell.y / m_slabSize) * m_slabColumns + cell.x / m_slabSize; };
+	Reservation* findReservation (const unsigned long textureID);
+	const AtlasedTexture* place (const unsigned long textureID, const size_t sizeClass, const Cell& cell, const unsigned int width, const unsigned int height);
+};
+
+// Slabs are handed out in row order from the top left.
+SlabAtlas::SlabAtlas(TextureSource* source, const unsigned int width, const unsigned int height, const unsigned int slabSize) :
+	m_source(source),
+	m_width(width),
+	m_height(height),
+	m_slabSize(slabSize ? slabSize : 1),
+	m_slabColumns(width / m_slabSize)
+{
+	m_slabUse.assign((size_t)m_slabColumns * (m_height / m_slabSize), 0);
+	for (unsigned int y = (m_height / m_slabSize) * m_slabSize; y >= m_slabSize; y -= m_slabSize)
+	{
+		for (unsigned int x = (m_width / m_slabSize) * m_slabSize; x >= m_slabSize; x -= m_slabSize)
+		{
+			Cell slab = { x - m_slabSize, y - m_slabSize };
+			m_freeSlabs.push_back(slab);
+		}
+	}
+}
+
+// Kept sorted by cell area so classFor() takes the first class that fits.
+bool SlabAtlas::addSizeClass (const unsigned int cellWidth, const unsigned int cellHeight)
+{
+	if (!cellWidth || !cellHeight || cellWidth > m_slabSize || cellHeight > m_slabSize || !m_textures.empty() || !m_reservations.empty())
+	{
+		return false;
+	}
+
+	SizeClass sizeClass;
+	sizeClass.width = cellWidth;
+	sizeClass.height = cellHeight;
+
+	std::vector<SizeClass>::iterator position = m_classes.begin();
+	while (position != m_classes.end() && position->width * position->height <= cellWidth * cellHeight)
+	{
+		++position;
+	}
+	m_classes.insert(position, sizeClass);
+	return true;
+}
+
+bool SlabAtlas::willFit (const unsigned long textureID)
+{
+	if (m_textures.count(textureID))
+	{
+		return true;
+	}
+
+	size_t sizeClass;
+	unsigned int width, height;
+	return classFor(textureID, sizeClass, width, height) && hasCell(sizeClass);
+}
+
+const AtlasedTexture* SlabAtlas::addTexture (const unsigned long textureID)
+{
+	const AtlasedTexture* existing = find(textureID);
+	if (existing)
+	{
+		return existing;
+	}
+
+	size_t sizeClass;
+	unsigned int width, height;
+	if (!classFor(textureID, sizeClass, width, height) || !hasCell(sizeClass))
+	{
+		return NULL;
+	}
+
+	return place(textureID, sizeClass, takeCell(sizeClass), width, height);
+}
+
+const AtlasedTexture* SlabAtlas::find (const unsigned long textureID) const
+{
+	std::map<unsigned long, Slot>::const_iterator found = m_textures.find(textureID);
+	return found == m_textures.end() ? NULL : &found->second.texture;
+}
+
+bool SlabAtlas::removeTexture (const unsigned long textureID)
+{
+	std::map<unsigned long, Slot>::iterator found = m_textures.find(textureID);
+	if (found == m_textures.end())
+	{
+		return false;
+	}
+
+	freeCell(found->second.sizeClass, found->second.cell);
+	m_textures.erase(found);
+	return true;
+}
+
+// Removing a texture of the class gives back a cell it fits; removing every texture of a
+// slab gives back the slab.
+bool SlabAtlas::fitsWithout (const unsigned long textureID, const std::vector<unsigned long>& removed)
+{
+	if (willFit(textureID))
+	{
+		return true;
+	}
+
+	size_t sizeClass;
+	unsigned int width, height;
+	if (!classFor(textureID, sizeClass, width, height))
+	{
+		return false;
+	}
+
+	std::map<size_t, unsigned int> freed;
+	for (size_t i = 0; i < removed.size(); ++i)
+	{
+		std::map<unsigned long, Slot>::const_iterator found = m_textures.find(removed[i]);
+		if (found == m_textures.end())
+		{
+			continue;
+		}
+		const size_t slab = slabOf(found->second.cell);
+		if (found->second.sizeClass == sizeClass || ++freed[slab] == m_slabUse[slab])
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SlabAtlas::reserve (const unsigned long textureID)
+{
+	if (find(textureID) || findReservation(textureID))
+	{
+		return true;
+	}
+
+	Reservation reservation;
+	reservation.textureID = textureID;
+	if (!classFor(textureID, reservation.sizeClass, reservation.width, reservation.height) || !hasCell(reservation.sizeClass))
+	{
+		return false;
+	}
+
+	reservation.cell = takeCell(reservation.sizeClass);
+	m_reservations.push_back(reservation);
+	return true;
+}
+
+const AtlasedTexture* SlabAtlas::commit (const unsigned long textureID)
+{
+	Reservation* reservation = findReservation(textureID);
+	if (!reservation)
+	{
+		return addTexture(textureID);
+	}
+
+	const Reservation held = *reservation;
+	m_reservations.erase(m_reservations.begin() + (reservation - &m_reservations[0]));
+	return place(held.textureID, held.sizeClass, held.cell, held.width, held.height);
+}
+
+void SlabAtlas::rollback (const unsigned long textureID)
+{
+	Reservation* reservation = findReservation(textureID);
+	if (!reservation)
+	{
+		return;
+	}
+
+	freeCell(reservation->sizeClass, reservation->cell);
+	m_reservations.erase(m_reservations.begin() + (reservation - &m_reservations[0]));
+}
+
+bool SlabAtlas::classFor (const unsigned long textureID, size_t& sizeClass, unsigned int& width, unsigned int& height)
+{
+	if (!m_source->getSize(textureID, width, height))
+	{
+		return false;
+	}
+
+	for (sizeClass = 0; sizeClass < m_classes.size(); ++sizeClass)
+	{
+		if (width <= m_classes[sizeClass].width && height <= m_classes[sizeClass].height)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+inline bool SlabAtlas::hasCell (const size_t sizeClass) const
+{
+	return !m_classes[sizeClass].freeCells.empty() || !m_freeSlabs.empty();
+}
+
+// Carves a fresh slab when the class has no free cell; hasCell() must be true.
+SlabAtlas::Cell SlabAtlas::takeCell (const size_t sizeClass)
+{
+	SizeClass& cells = m_classes[sizeClass];
+	if (cells.freeCells.empty())
+	{
+		const Cell slab = m_freeSlabs.back();
+		m_freeSlabs.pop_back();
+
+		for (unsigned int y = (m_slabSize / cells.height) * cells.height; y >= cells.height; y -= cells.height)
+		{
+			for (unsigned int x = (m_slabSize / cells.width) * cells.width; x >= cells.width; x -= cells.width)
+			{
+				Cell cell = { slab.x + x - cells.width, slab.y + y - cells.height };
+				cells.freeCells.push_back(cell);
+			}
+		}
+	}
+
+	const Cell cell = cells.freeCells.back();
+	cells.freeCells.pop_back();
+	++m_slabUse[slabOf(cell)];
+	return cell;
+}
+
+// A slab left with no cell in use leaves its class: its cells come off the free list and
+// the slab goes back to the free slabs.
+void SlabAtlas::freeCell (const size_t sizeClass, const Cell& cell)
+{
+	std::vector<Cell>& freeCells = m_classes[sizeClass].freeCells;
+	freeCells.push_back(cell);
+
+	const size_t slab = slabOf(cell);
+	if (--m_slabUse[slab])
+	{
+		return;
+	}
+
+	const Cell origin = { cell.x / m_slabSize * m_slabSize, cell.y / m_slabSize * m_slabSize };
+	for (size_t i = 0; i < freeCells.size(); )
+	{
+		if (slabOf(freeCells[i]) == slab)
+		{
+			freeCells[i] = freeCells.back();
+			freeCells.pop_back();
+		}
+		else
+		{
+			++i;
+		}
+	}
+	m_freeSlabs.push_back(origin);
+}
+
+SlabAtlas::Reservation* SlabAtlas::findReservation (const unsigned long textureID)
+{
+	for (size_t i = 0; i < m_reservations.size(); ++i)
+	{
+		if (m_reservations[i].textureID == textureID)
+		{
+			return &m_reservations[i];
+		}
+	}
+	return NULL;
+}
+
+const AtlasedTexture* SlabAtlas::place (const unsigned long textureID, const size_t sizeClass, const Cell& cell, const unsigned int width, const unsigned int height)
+{
+	Slot& slot = m_textures[textureID];
+	slot.sizeClass = sizeClass;
+	slot.cell = cell;
+
+	AtlasedTexture& texture = slot.texture;
+	texture.x = cell.x;
+	texture.y = cell.y;
+	texture.width = width;
+	texture.height = height;
+	texture.sourceWidth = width;
+	texture.sourceHeight = height;
+	texture.u0 = (float)cell.x / m_width;
+	texture.v0 = (float)cell.y / m_height;
+	texture.u1 = (float)(cell.x + width) / m_width;
+	texture.v1 = (float)(cell.y + height) / m_height;
+	return &texture;
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef SORTED_BATCH_ASSIGNER_CPP
+#define SORTED_BATCH_ASSIGNER_CPP
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "BatchCatalogueRegistry.cpp"
+
+// Alternative to feeding objects one at a time through BatchCatalogueRegistry::catalogueFor.
+// The frame is radix sorted on (BatchKey, primary texture id) and swept in one pass: each
+// key run fills the newest catalogue for that key until its atlas rejects a texture, then
+// opens another. Without atlas rejections the catalogues (key and texture set) are the same
+// as the per-object path builds, though created in key order rather than first-seen order.
+// Once full, a catalogue is not revisited, so with rejections the split can differ.
+class SortedBatchAssigner {
+public:
+	inline SortedBatchAssigner(BatchCatalogueRegistry& registry) : m_registry(registry) {};
+
+	size_t assign (const BatchDescriptor* descriptors, const size_t count, BatchCatalogue** assignments);
+
+private:
+	struct Entry {
+		uint64_t key;
+		uint32_t textureId;
+		uint32_t index;
+	};
+
+	BatchCatalogueRegistry& m_registry;
+	std::vector<Entry> m_entries;
+	std::vector<Entry> m_scratch;
+
+	void buildEntries (const BatchDescriptor* descriptors, const size_t count);
+	void sortEntries();
+	bool sortPass (const size_t byte);
+
+	static inline uint8_t digit (const Entry& entry, const size_t byte) {
+		return byte < 4 ? (uint8_t)(entry.textureId >> (byte * 8)) : (uint8_t)(entry.key >> ((byte - 4) * 8));
+	};
+
+	SortedBatchAssigner(const SortedBatchAssigner&);
+	SortedBatchAssigner& operator=(const SortedBatchAssigner&);
+};
+
+// assignments[i] receives the catalogue for descriptors[i], or NULL when even a fresh
+// catalogue could not take it. Returns the number of objects assigned.
+size_t SortedBatchAssigner::assign (const BatchDescriptor* descriptors, const size_t count, BatchCatalogue** assignments)
+{
+	buildEntries(descriptors, count);
+	sortEntries();
+
+	// catalogue is the newest one for the current key, target where the current texture went.
+	// A texture even a fresh catalogue rejects stays unassigned for the rest of its run, and
+	// the key's next texture goes back to the newest catalogue.
+	size_t assigned = 0;
+	BatchCatalogue* catalogue = NULL;
+	BatchCatalogue* target = NULL;
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		const Entry& entry = m_entries[i];
+		const BatchDescriptor& descriptor = descriptors[entry.index];
+		const bool sameKey = i > 0 && m_entries[i - 1].key == entry.key;
+		if (!sameKey)
+		{
+			catalogue = NULL;
+		}
+
+		if (!sameKey || m_entries[i - 1].textureId != entry.textureId)
+		{
+			target = NULL;
+			if (catalogue && catalogue->place(descriptor))
+			{
+				target = catalogue;
+			}
+			else
+			{
+				BatchCatalogue* opened = m_registry.openCatalogue(descriptor, BatchKey::fromValue(entry.key));
+				if (opened)
+				{
+					catalogue = target = opened;
+				}
+			}
+		}
+
+		assignments[entry.index] = target;
+		if (target)
+		{
+			++assigned;
+		}
+	}
+
+	return assigned;
+}
+
+// Keys are built with a one-entry shader pair cache; runs of objects usually share shaders.
+void SortedBatchAssigner::buildEntries (const BatchDescriptor* descriptors, const size_t count)
+{
+	m_entries.resize(count);
+
+	const ShaderObject* vShader = NULL;
+	const ShaderObject* fShader = NULL;
+	unsigned short programId = ShaderProgramTable::shared().intern(NULL, NULL);
+	for (size_t i = 0; i < count; ++i)
+	{
+		const BatchDescriptor& descriptor = descriptors[i];
+		if (descriptor.vShader != vShader || descriptor.fShader != fShader)
+		{
+			vShader = descriptor.vShader;
+			fShader = descriptor.fShader;
+			programId = ShaderProgramTable::shared().intern(vShader, fShader);
+		}
+
+		m_entries[i].key = BatchKey(descriptor.format, descriptor.isStatic, programId, descriptor.indicies).value();
+		m_entries[i].textureId = descriptor.textureIds[0];
+		m_entries[i].index = (uint32_t)i;
+	}
+}
+
+// LSD radix sort, one byte per pass, texture id bytes first then key bytes. Passes where
+// every entry has the same digit are skipped, which is most of the key in practice.
+void SortedBatchAssigner::sortEntries()
+{
+	m_scratch.resize(m_entries.size());
+	for (size_t byte = 0; byte < 12; ++byte)
+	{
+		if (sortPass(byte))
+		{
+			m_entries.swap(m_scratch);
+		}
+	}
+}
+
+bool SortedBatchAssigner::sortPass (const size_t byte)
+{
+	size_t counts[256] = { 0 };
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		++counts[digit(m_entries[i], byte)];
+	}
+
+	size_t offset = 0;
+	for (size_t d = 0; d < 256; ++d)
+	{
+		if (counts[d] == m_entries.size())
+		{
+			return false;
+		}
+		size_t bucket = counts[d];
+		counts[d] = offset;
+		offset += bucket;
+	}
+
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		m_scratch[counts[digit(m_entries[i], byte)]++] = m_entries[i];
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef TEXTURE_ARRAY_ATLAS_CPP
+#define TEXTURE_ARRAY_ATLAS_CPP
+
+#include <map>
+#include <vector>
+#include <stddef.h>
+#include "PackedAtlas.cpp"
+
+// TextureManager::Atlas over the layers of a texture array, for uniformly sized assets such
+// as tiles and icons. Each texture takes a whole layer at its origin, so there is no packing:
+// free layers are a stack and willFit is a size check plus an emptiness test. UVs cover the
+// texture's part of its layer, which is all of it when sizes match the layer.
+class TextureArrayAtlas : public TextureManager::Atlas {
+public:
+	TextureArrayAtlas(TextureSource* source, const unsigned int width, const unsigned int height, const unsigned int layers);
+
+	bool willFit (const unsigned long textureID);
+	const AtlasedTexture* addTexture (const unsigned long textureID);
+	const AtlasedTexture* find (const unsigned long textureID) const;
+	bool removeTexture (const unsigned long textureID);
+	bool fitsWithout (const unsigned long textureID, const std::vector<unsigned long>& removed);
+
+	bool reserve (const unsigned long textureID);
+	const AtlasedTexture* commit (const unsigned long textureID);
+	void rollback (const unsigned long textureID);
+
+	inline size_t textureCount() const { return m_textures.size(); };
+	inline size_t freeLayerCount() const { return m_freeLayers.size(); };
+	inline unsigned int layerCount() const { return m_layers; };
+	inline unsigned int layerWidth() const { return m_width; };
+	inline unsigned int layerHeight() const { return m_height; };
+
+private:
+	struct Reservation {
+		unsigned long textureID;
+		unsigned int layer;
+		unsigned int width;
+		unsigned int height;
+	};
+
+	TextureSource* m_source;
+	const unsigned int m_width;
+	const unsigned int m_height;
+	const unsigned int m_layers;
+	std::vector<unsigned int> m_freeLayers;
+	std::vector<Reservation> m_reservations;
+	std::map<unsigned long, AtlasedTexture> m_textures;
+
+	bool sizeFor (const unsigned long textureID, unsigned int& width, unsigned int& height);
+	Reservation* findReservation (const unsigned long textureID);
+	const AtlasedTexture* place (const unsigned long textureID, const unsigned int layer, const unsigned int width, const unsigned int height);
+};
+
+// Layers are handed out lowest index first.
+TextureArrayAtlas::TextureArrayAtlas(TextureSource* source, const unsigned int width, const unsigned int height, const unsigned int layers) :
+	m_source(source),
+	m_width(width),
+	m_height(height),
+	m_layers(layers)
+{
+	m_freeLayers.reserve(layers);
+	for (unsigned int layer = layers; layer > 0; --layer)
+	{
+		m_freeLayers.push_back(layer - 1);
+	}
+}
+
+bool TextureArrayAtlas::willFit (const unsigned long textureID)
+{
+	if (m_textures.count(textureID))
+	{
+		return true;
+	}
+
+	unsigned int width, height;
+	return !m_freeLayers.empty() && sizeFor(textureID, width, height);
+}
+
+const AtlasedTexture* TextureArrayAtlas::addTexture (const unsigned long textureID)
+{
+	const AtlasedTexture* existing = find(textureID);
+	if (existing)
+	{
+		return existing;
+	}
+
+	unsigned int width, height;
+	if (m_freeLayers.empty() || !sizeFor(textureID, width, height))
+	{
+		return NULL;
+	}
+
+	const unsigned int layer = m_freeLayers.back();
+	m_freeLayers.pop_back();
+	return place(textureID, layer, width, height);
+}
+
+const AtlasedTexture* TextureArrayAtlas::find (const unsigned long textureID) const
+{
+	std::map<unsigned long, AtlasedTexture>::const_iterator found = m_textures.find(textureID);
+	return found == m_textures.end() ? NULL : &found->second;
+}
+
+bool TextureArrayAtlas::removeTexture (const unsigned long textureID)
+{
+	std::map<unsigned long, AtlasedTexture>::iterator found = m_textures.find(textureID);
+	if (found == m_textures.end())
+	{
+		return false;
+	}
+
+	m_freeLayers.push_back(found->second.layer);
+	m_textures.erase(found);
+	return true;
+}
+
+// Any removed texture gives back a whole layer.
+bool TextureArrayAtlas::fitsWithout (const unsigned long textureID, const std::vector<unsigned long>& removed)
+{
+	if (willFit(textureID))
+	{
+		return true;
+	}
+
+	unsigned int width, height;
+	if (!sizeFor(textureID, width, height))
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < removed.size(); ++i)
+	{
+		if (m_textures.count(removed[i]))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// A reservation holds its layer off the free stack, so rollbacks may come in any order.
+bool TextureArrayAtlas::reserve (const unsigned long textureID)
+{
+	if (find(textureID) || findReservation(textureID))
+	{
+		return true;
+	}
+
+	Reservation reservation = { textureID, 0, 0, 0 };
+	if (m_freeLayers.empty() || !sizeFor(textureID, reservation.width, reservation.height))
+	{
+		return false;
+	}
+
+	reservation.layer = m_freeLayers.back();
+	m_freeLayers.pop_back();
+	m_reservations.push_back(reservation);
+	return true;
+}
+
+const AtlasedTexture* TextureArrayAtlas::commit (const unsigned long textureID)
+{
+	Reservation* reservation = findReservation(textureID);
+	if (!reservation)
+	{
+		return addTexture(textureID);
+	}
+
+	const Reservation held = *reservation;
+	m_reservations.erase(m_reservations.begin() + (reservation - &m_reservations[0]));
+	return place(held.textureID, held.layer, held.width, held.height);
+}
+
+void TextureArrayAtlas::rollback (const unsigned long textureID)
+{
+	Reservation* reservation = findReservation(textureID);
+	if (!reservation)
+	{
+		return;
+	}
+
+	m_freeLayers.push_back(reservation->layer);
+	m_reservations.erase(m_reservations.begin() + (reservation - &m_reservations[0]));
+}
+
+bool TextureArrayAtlas::sizeFor (const unsigned long textureID, unsigned int& width, unsigned int& height)
+{
+	return m_source->getSize(textureID, width, height) && width <= m_width && height <= m_height;
+}
+
+TextureArrayAtlas::Reservation* TextureArrayAtlas::findReservation (const unsigned long textureID)
+{
+	for (size_t i = 0; i < m_reservations.size(); ++i)
+	{
+		if (m_reservations[i].textureID == textureID)
+		{
+			return &m_reservations[i];
+		}
+	}
+	return NULL;
+}
+
+const AtlasedTexture* TextureArrayAtlas::place (const unsigned long textureID, const unsigned int layer, const unsigned int width, const unsigned int height)
+{
+	AtlasedTexture& texture = m_textures[textureID];
+	texture.width = width;
+	texture.height = height;
+	texture.sourceWidth = width;
+	texture.sourceHeight = height;
+	texture.layer = layer;
+	texture.u1 = (float)width / m_width;
+	texture.v1 = (float)height / m_height;
+	return &texture;
+}
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef TEXTURE_ID_SET_CPP
+#define TEXTURE_ID_SET_CPP
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "TextureRegistry.cpp"
+
+// Set of texture ids. Small sets are scanned linearly (four ids per compare with SSE2);
+// past kLinearLimit the ids are interned through TextureRegistry::shared() and kept as a
+// bitset over the dense indices, so membership is one bit test.
+// lookup() returns the slot an absent id would go in, so insertAt() does not probe again.
+// Lookups never intern: only ids actually inserted take an index, and a set holds a
+// reference on each of its indices until it is cleared or destroyed.
+class TextureIdSet {
+public:
+	inline TextureIdSet() : m_size(0) {};
+	TextureIdSet(const TextureIdSet& other);
+	TextureIdSet& operator=(const TextureIdSet& other);
+	inline ~TextureIdSet() { clear(); };
+
+	bool contains (const unsigned int textureId) const;
+	bool insert (const unsigned int textureId);
+	size_t lookup (const unsigned int textureId, bool& found) const;
+	void insertAt (const size_t slot, const unsigned int textureId);
+	void clear();
+
+	inline size_t size() const { return m_size; };
+	inline bool empty() const { return m_size == 0; };
+	std::vector<unsigned int> ids() const;
+
+	static const size_t kLinearLimit = 32;
+	// lookup()'s slot for an id the registry has not interned yet.
+	static const size_t kNotInterned = ~(size_t)0;
+
+private:
+	std::vector<unsigned int> m_ids;
+	TextureBitset m_bits;
+	size_t m_size;
+
+	inline bool isLinear() const { return m_size <= kLinearLimit; };
+	size_t scan (const unsigned int textureId) const;
+	void retainIndices() const;
+};
+
+TextureIdSet::TextureIdSet(const TextureIdSet& other) :
+	m_ids(other.m_ids),
+	m_bits(other.m_bits),
+	m_size(other.m_size)
+{
+	retainIndices();
+}
+
+TextureIdSet& TextureIdSet::operator=(const TextureIdSet& other)
+{
+	if (this != &other)
+	{
+		clear();
+		m_ids = other.m_ids;
+		m_bits = other.m_bits;
+		m_size = other.m_size;
+		retainIndices();
+	}
+	return *this;
+}
+
+bool TextureIdSet::contains (const unsigned int textureId) const
+{
+	if (isLinear())
+	{
+		return scan(textureId) < m_ids.size();
+	}
+
+	unsigned int index;
+	return TextureRegistry::shared().find(textureId, index) && m_bits.test(index);
+}
+
+bool TextureIdSet::insert (const unsigned int textureId)
+{
+	bool found;
+	size_t slot = lookup(textureId, found);
+	if (found)
+	{
+		return false;
+	}
+
+	insertAt(slot, textureId);
+	return true;
+}
+
+size_t TextureIdSet::lookup (const unsigned int textureId, bool& found) const
+{
+	if (isLinear())
+	{
+		size_t position = scan(textureId);
+		found = position < m_ids.size();
+		return position;
+	}
+
+	unsigned int index;
+	if (!TextureRegistry::shared().find(textureId, index))
+	{
+		found = false;
+		return kNotInterned;
+	}
+	found = m_bits.test(index);
+	return index;
+}
+
+// slot must come from a lookup() that did not find textureId, with no insert in between.
+void TextureIdSet::insertAt (const size_t slot, const unsigned int textureId)
+{
+	++m_size;
+
+	if (!isLinear() && m_ids.empty())
+	{
+		m_bits.set(slot == kNotInterned ? TextureRegistry::shared().intern(textureId) : (unsigned int)slot);
+		return;
+	}
+
+	m_ids.push_back(textureId);
+	if (isLinear())
+	{
+		return;
+	}
+
+	TextureRegistry& registry = TextureRegistry::shared();
+	for (size_t i = 0; i < m_ids.size(); ++i)
+	{
+		m_bits.set(registry.intern(m_ids[i]));
+	}
+	std::vector<unsigned int>().swap(m_ids);
+}
+
+void TextureIdSet::clear()
+{
+	if (!isLinear())
+	{
+		TextureRegistry& registry = TextureRegistry::shared();
+		for (size_t index = m_bits.next(0); index < m_bits.end(); index = m_bits.next(index + 1))
+		{
+			registry.release((unsigned int)index);
+		}
+	}
+	std::vector<unsigned int>().swap(m_ids);
+	m_bits.clear();
+	m_size = 0;
+}
+
+// Insertion order while linear, dense index order once interned.
+std::vector<unsigned int> TextureIdSet::ids() const
+{
+	if (isLinear())
+	{
+		return m_ids;
+	}
+
+	std::vector<unsigned int> textureIds;
+	textureIds.reserve(m_size);
+
+	const TextureRegistry& registry = TextureRegistry::shared();
+	for (size_t index = m_bits.next(0); index < m_bits.end(); index = m_bits.next(index + 1))
+	{
+		textureIds.push_back(registry.textureIdAt((unsigned int)index));
+	}
+	return textureIds;
+}
+
+void TextureIdSet::retainIndices() const
+{
+	if (isLinear())
+	{
+		return;
+	}
+
+	TextureRegistry& registry = TextureRegistry::shared();
+	for (size_t index = m_bits.next(0); index < m_bits.end(); index = m_bits.next(index + 1))
+	{
+		registry.retain((unsigned int)index);
+	}
+}
+
+size_t TextureIdSet::scan (const unsigned int textureId) const
+{
+	const size_t count = m_ids.size();
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128i needle = _mm_set1_epi32((int)textureId);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i ids = _mm_loadu_si128((const __m128i*)&m_ids[i]);
+		int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(ids, needle)));
+		if (mask)
+		{
+			return i + __builtin_ctz(mask);
+		}
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		if (m_ids[i] == textureId)
+		{
+			return i;
+		}
+	}
+
+	return count;
+}
+
+#endif
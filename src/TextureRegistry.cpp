@@ -0,0 +1,210 @@
+#ifndef TEXTURE_REGISTRY_CPP
+#define TEXTURE_REGISTRY_CPP
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+// Interns sparse texture ids into dense indices so texture sets can be kept as bitsets.
+// Each intern() holds a reference on the index until release(); an index nothing holds is
+// forgotten and handed to the next new id, so indices stay below the number of ids sets
+// hold at once rather than growing with every id ever seen. New indices are numbered in
+// first-seen order while none has been freed.
+class TextureRegistry {
+public:
+	inline TextureRegistry() : m_index(kInitialSlots, -1), m_live(0) {};
+
+	static TextureRegistry& shared();
+
+	unsigned int intern (const unsigned int textureId);
+	bool find (const unsigned int textureId, unsigned int& index) const;
+	inline void retain (const unsigned int index) { ++m_references[index]; };
+	void release (const unsigned int index);
+	inline unsigned int textureIdAt (const unsigned int index) const { return m_textureIds[index]; };
+	inline size_t size() const { return m_live; };
+
+	static size_t hash (const unsigned int textureId);
+
+private:
+	std::vector<unsigned int> m_textureIds;
+	std::vector<unsigned int> m_references;
+	std::vector<unsigned int> m_freeIndices;
+	std::vector<int> m_index;
+	size_t m_live;
+
+	size_t slotFor (const unsigned int textureId) const;
+	void erase (size_t slot);
+	void grow();
+
+	static const size_t kInitialSlots = 1024;
+};
+
+class TextureBitset {
+public:
+	inline TextureBitset() {};
+
+	inline bool test (const unsigned int index) const {
+		return (index >> 6) < m_words.size() && (m_words[index >> 6] >> (index & 63)) & 1;
+	};
+	inline void set (const unsigned int index) {
+		if ((index >> 6) >= m_words.size()) {
+			m_words.resize((index >> 6) + 1, 0);
+		}
+		m_words[index >> 6] |= (uint64_t)1 << (index & 63);
+	};
+	inline void clear() { m_words.clear(); };
+
+	size_t next (const size_t from) const;
+	inline size_t end() const { return m_words.size() * 64; };
+
+private:
+	std::vector<uint64_t> m_words;
+};
+
+TextureRegistry& TextureRegistry::shared()
+{
+	static TextureRegistry registry;
+	return registry;
+}
+
+unsigned int TextureRegistry::intern (const unsigned int textureId)
+{
+	size_t slot = slotFor(textureId);
+	if (m_index[slot] >= 0)
+	{
+		++m_references[m_index[slot]];
+		return (unsigned int)m_index[slot];
+	}
+
+	unsigned int index;
+	if (m_freeIndices.empty())
+	{
+		index = (unsigned int)m_textureIds.size();
+		m_textureIds.push_back(textureId);
+		m_references.push_back(1);
+	}
+	else
+	{
+		index = m_freeIndices.back();
+		m_freeIndices.pop_back();
+		m_textureIds[index] = textureId;
+		m_references[index] = 1;
+	}
+	m_index[slot] = (int)index;
+	++m_live;
+
+	if (m_live * 2 > m_index.size())
+	{
+		grow();
+	}
+
+	return index;
+}
+
+void TextureRegistry::release (const unsigned int index)
+{
+	if (--m_references[index])
+	{
+		return;
+	}
+
+	erase(slotFor(m_textureIds[index]));
+	m_freeIndices.push_back(index);
+	--m_live;
+}
+
+bool TextureRegistry::find (const unsigned int textureId, unsigned int& index) const
+{
+	size_t slot = slotFor(textureId);
+	if (m_index[slot] < 0)
+	{
+		return false;
+	}
+
+	index = (unsigned int)m_index[slot];
+	return true;
+}
+
+size_t TextureRegistry::slotFor (const unsigned int textureId) const
+{
+	const size_t mask = m_index.size() - 1;
+	size_t slot = hash(textureId) & mask;
+	while (m_index[slot] >= 0 && m_textureIds[m_index[slot]] != textureId)
+	{
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+// Backward-shift deletion: later entries of the probe run move into the hole when it lies
+// between their home slot and where they sit, so no tombstones are needed.
+void TextureRegistry::erase (size_t slot)
+{
+	const size_t mask = m_index.size() - 1;
+	for (size_t next = (slot + 1) & mask; m_index[next] >= 0; next = (next + 1) & mask)
+	{
+		const size_t home = hash(m_textureIds[m_index[next]]) & mask;
+		if (((next - home) & mask) >= ((next - slot) & mask))
+		{
+			m_index[slot] = m_index[next];
+			slot = next;
+		}
+	}
+	m_index[slot] = -1;
+}
+
+void TextureRegistry::grow()
+{
+	m_index.assign(m_index.size() * 2, -1);
+
+	const size_t mask = m_index.size() - 1;
+	for (size_t i = 0; i < m_textureIds.size(); ++i)
+	{
+		if (!m_references[i])
+		{
+			continue;
+		}
+		size_t slot = hash(m_textureIds[i]) & mask;
+		while (m_index[slot] >= 0)
+		{
+			slot = (slot + 1) & mask;
+		}
+		m_index[slot] = (int)i;
+	}
+}
+
+// lowbias32 integer mix; sequential ids still spread over the whole table.
+size_t TextureRegistry::hash (const unsigned int textureId)
+{
+	uint32_t h = textureId;
+	h ^= h >> 16;
+	h *= 0x7feb352dU;
+	h ^= h >> 15;
+	h *= 0x846ca68bU;
+	h ^= h >> 16;
+	return (size_t)h;
+}
+
+// First set index at or after from, or end() when there is none.
+size_t TextureBitset::next (const size_t from) const
+{
+	size_t word = from >> 6;
+	if (word >= m_words.size())
+	{
+		return end();
+	}
+
+	uint64_t bits = m_words[word] & (~(uint64_t)0 << (from & 63));
+	while (!bits)
+	{
+		if (++word >= m_words.size())
+		{
+			return end();
+		}
+		bits = m_words[word];
+	}
+
+	return (word << 6) + __builtin_ctzll(bits);
+}
+
+#endif
@@ -1,6 +1,29 @@
+#ifndef MIN_DEPS_CPP
+#define MIN_DEPS_CPP
+
+#include <vector>
+
 class ShaderObject {};
 
-class AtlasedTexture {};
+class AtlasedTexture {
+public:
+	AtlasedTexture() : x(0), y(0), width(0), height(0), layer(0), trimX(0), trimY(0), sourceWidth(0), sourceHeight(0), u0(0), v0(0), u1(0), v1(0) {};
+	unsigned int x;
+	unsigned int y;
+	unsigned int width;
+	unsigned int height;
+	unsigned int layer;
+	// Where the stored rect sits in the original image when transparent borders were trimmed;
+	// a quad for the whole image is the stored quad grown by these margins.
+	unsigned int trimX;
+	unsigned int trimY;
+	unsigned int sourceWidth;
+	unsigned int sourceHeight;
+	float u0;
+	float v0;
+	float u1;
+	float v1;
+};
 
 class BufferedBatch {
 public:
@@ -14,11 +37,35 @@ class TextureManager {
 public:
 	class Atlas {
 	public:
+		virtual ~Atlas() {};
 		virtual bool willFit (const unsigned long textureID) = 0;
 		virtual const AtlasedTexture* addTexture(const unsigned long textureID) = 0;
+		// Transactional placement: space is held from reserve until commit or rollback, and
+		// rollbacks come in reverse reservation order. The defaults only check willFit.
+		virtual bool reserve (const unsigned long textureID) { return willFit(textureID); };
+		virtual const AtlasedTexture* commit (const unsigned long textureID) { return addTexture(textureID); };
+		virtual void rollback (const unsigned long) {};
+		// Frees a texture's space; atlases that only grow return false.
+		virtual bool removeTexture (const unsigned long) { return false; };
+		// Whether the texture would fit once the given textures were removed, without removing
+		// any, so an evicting wrapper removes only what makes room. False when it cannot tell.
+		virtual bool fitsWithout (const unsigned long, const std::vector<unsigned long>&) { return false; };
+		// Catalogues retain each texture they place and release it when destroyed, so an
+		// evicting atlas knows which textures are still referenced.
+		virtual void retain (const unsigned long) {};
+		virtual void release (const unsigned long) {};
 	};
 };
 
+struct BatchDescriptor {
+	unsigned long format;
+	bool isStatic;
+	const ShaderObject* vShader;
+	const ShaderObject* fShader;
+	bool indicies;
+	unsigned int textureIds[4];
+};
+
 class BatchableObject {
 public:
 	virtual unsigned long getDataFormat() const = 0;
@@ -30,4 +77,18 @@ public:
 	unsigned int getPrimaryTextureID() const {
 		return getTextureID(0);
 	}
-};
\ No newline at end of file
+	// Objects on the hot path should override this to fill the descriptor in one call.
+	virtual void describe(BatchDescriptor& descriptor) const {
+		descriptor.format = getDataFormat();
+		descriptor.isStatic = isStatic();
+		descriptor.vShader = getVertexShader();
+		descriptor.fShader = getFragmentShader();
+		descriptor.indicies = hasIndicies();
+		descriptor.textureIds[0] = getPrimaryTextureID();
+		descriptor.textureIds[1] = (descriptor.format & BufferedBatch::kFormatUsesTextureUnit1) ? getTextureID(1) : 0;
+		descriptor.textureIds[2] = (descriptor.format & BufferedBatch::kFormatUsesTextureUnit2) ? getTextureID(2) : 0;
+		descriptor.textureIds[3] = (descriptor.format & BufferedBatch::kFormatUsesTextureUnit3) ? getTextureID(3) : 0;
+	}
+};
+
+#endif
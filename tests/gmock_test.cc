@@ -1,4 +1,15 @@
 #include "../src/BatchCatalogue.cpp"
+#include "../src/BatchCatalogueRegistry.cpp"
+#include "../src/SortedBatchAssigner.cpp"
+#include "../src/ParallelCatalogueBuilder.cpp"
+#include "../src/SkylineAtlas.cpp"
+#include "../src/MaxRectsAtlas.cpp"
+#include "../src/TextureArrayAtlas.cpp"
+#include "../src/SlabAtlas.cpp"
+#include "../src/LruAtlas.cpp"
+#include "../src/AtlasRepacker.cpp"
+#include "../src/BakedAtlas.cpp"
+#include "../src/PageGrouping.cpp"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -9,11 +20,11 @@ public:
 	{};
 
 	void addSupportedTexture(unsigned int textureId) {
-		m_texturesAlreadyInCatalogue.push_back(textureId);
+		m_texturesAlreadyInCatalogue.insert(textureId);
 	}
 
 	std::vector<unsigned int> getTextures() {
-		return m_texturesAlreadyInCatalogue;
+		return m_texturesAlreadyInCatalogue.ids();
 	}
 };
 
@@ -31,6 +42,163 @@ public:
 	};
 };
 
+class BatchCatalogueRegistryWithStubTexture : public BatchCatalogueRegistry {
+public:
+	std::vector<unsigned int> getTextures(BatchCatalogue* catalogue) {
+		std::vector<unsigned int> textures = static_cast<BatchCatalogueWithStubTexture*>(catalogue)->getTextures();
+		std::sort(textures.begin(), textures.end());
+		return textures;
+	}
+
+protected:
+	BatchCatalogue* createCatalogue (const BatchDescriptor& descriptor) {
+		return new BatchCatalogueWithStubTexture(descriptor.format, descriptor.isStatic, descriptor.vShader, descriptor.fShader, descriptor.indicies);
+	}
+};
+
+class BatchCatalogueRegistryWithAtlas : public BatchCatalogueRegistry {
+public:
+	inline BatchCatalogueRegistryWithAtlas(TextureManager::Atlas* atlas) : m_atlas(atlas) {};
+
+protected:
+	TextureManager::Atlas* m_atlas;
+
+	BatchCatalogue* createCatalogue (const BatchDescriptor& descriptor) {
+		return new BatchCatalogueWithAtlas(descriptor.format, descriptor.isStatic, descriptor.vShader, descriptor.fShader, descriptor.indicies, m_atlas, NULL, NULL, NULL);
+	}
+};
+
+// What the atlas test doubles hand out for a placed texture.
+static const AtlasedTexture kPlacedTexture = AtlasedTexture();
+
+class StubAtlasWithCapacity : public TextureManager::Atlas {
+public:
+	inline StubAtlasWithCapacity(size_t capacity) : m_capacity(capacity) {};
+
+	bool willFit (const unsigned long) { return m_capacity > 0; }
+	const AtlasedTexture* addTexture(const unsigned long) { --m_capacity; return &kPlacedTexture; }
+
+private:
+	size_t m_capacity;
+};
+
+class BatchCatalogueRegistryWithCapacity : public BatchCatalogueRegistry {
+public:
+	inline BatchCatalogueRegistryWithCapacity(size_t capacity) : m_capacity(capacity) {};
+	~BatchCatalogueRegistryWithCapacity() {
+		clear();
+		for (size_t i = 0; i < m_atlases.size(); ++i) {
+			delete m_atlases[i];
+		}
+	}
+
+	size_t indexOf(const BatchCatalogue* catalogue) const {
+		for (size_t i = 0; i < size(); ++i) {
+			if (at(i) == catalogue) {
+				return i;
+			}
+		}
+		return size();
+	}
+
+protected:
+	size_t m_capacity;
+	std::vector<StubAtlasWithCapacity*> m_atlases;
+
+	BatchCatalogue* createCatalogue (const BatchDescriptor& descriptor) {
+		m_atlases.push_back(new StubAtlasWithCapacity(m_capacity));
+		return new BatchCatalogueWithAtlas(descriptor.format, descriptor.isStatic, descriptor.vShader, descriptor.fShader, descriptor.indicies, m_atlases.back(), NULL, NULL, NULL);
+	}
+};
+
+class StubTextureSource : public TextureSource {
+public:
+	void addTexture(unsigned long textureID, unsigned int width, unsigned int height) {
+		m_sizes[textureID] = std::make_pair(width, height);
+	}
+
+	bool getSize (const unsigned long textureID, unsigned int& width, unsigned int& height) {
+		std::map<unsigned long, std::pair<unsigned int, unsigned int> >::const_iterator found = m_sizes.find(textureID);
+		if (found == m_sizes.end()) {
+			return false;
+		}
+		width = found->second.first;
+		height = found->second.second;
+		return true;
+	}
+
+protected:
+	std::map<unsigned long, std::pair<unsigned int, unsigned int> > m_sizes;
+};
+
+class StubImageSource : public StubTextureSource {
+public:
+	// Every pixel of the image is its own index plus base, so copies can be checked exactly.
+	void addImage(unsigned long textureID, unsigned int width, unsigned int height, uint32_t base) {
+		addTexture(textureID, width, height);
+		std::vector<uint32_t>& image = m_images[textureID];
+		image.resize(width * height);
+		for (size_t i = 0; i < image.size(); ++i) {
+			image[i] = base + (uint32_t)i;
+		}
+	}
+
+	// Like addImage, but only pixels inside the given rect have alpha; the rest are transparent.
+	void addSprite(unsigned long textureID, unsigned int width, unsigned int height, unsigned int opaqueX, unsigned int opaqueY, unsigned int opaqueWidth, unsigned int opaqueHeight, uint32_t base) {
+		addImage(textureID, width, height, base);
+		std::vector<uint32_t>& image = m_images[textureID];
+		for (unsigned int y = opaqueY; y < opaqueY + opaqueHeight; ++y) {
+			for (unsigned int x = opaqueX; x < opaqueX + opaqueWidth; ++x) {
+				image[y * width + x] |= 0xff000000u;
+			}
+		}
+	}
+
+	const uint32_t* getPixels (const unsigned long textureID) {
+		std::map<unsigned long, std::vector<uint32_t> >::const_iterator found = m_images.find(textureID);
+		return found == m_images.end() ? NULL : &found->second[0];
+	}
+
+private:
+	std::map<unsigned long, std::vector<uint32_t> > m_images;
+};
+
+class StubBlockSource : public StubTextureSource {
+public:
+	// 8-byte 4x4 blocks whose first byte is the texture id and second the block index.
+	void addBlockImage(unsigned long textureID, unsigned int width, unsigned int height) {
+		addTexture(textureID, width, height);
+		std::vector<uint8_t>& blocks = m_blocks[textureID];
+		blocks.assign(((width + 3) / 4) * ((height + 3) / 4) * 8, 0);
+		for (size_t block = 0; block < blocks.size() / 8; ++block) {
+			blocks[block * 8] = (uint8_t)textureID;
+			blocks[block * 8 + 1] = (uint8_t)block;
+		}
+	}
+
+	const uint8_t* getBlocks (const unsigned long textureID) {
+		std::map<unsigned long, std::vector<uint8_t> >::const_iterator found = m_blocks.find(textureID);
+		return found == m_blocks.end() ? NULL : &found->second[0];
+	}
+
+private:
+	std::map<unsigned long, std::vector<uint8_t> > m_blocks;
+};
+
+bool rectsOverlap(const AtlasedTexture& a, const AtlasedTexture& b) {
+	return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+void expectPackedWithoutOverlaps(const std::vector<const AtlasedTexture*>& placed, unsigned int width, unsigned int height) {
+	for (size_t i = 0; i < placed.size(); ++i) {
+		EXPECT_LE(placed[i]->x + placed[i]->width, width);
+		EXPECT_LE(placed[i]->y + placed[i]->height, height);
+		for (size_t j = i + 1; j < placed.size(); ++j) {
+			EXPECT_FALSE(rectsOverlap(*placed[i], *placed[j]));
+		}
+	}
+}
+
 class MockBatchableObject : public BatchableObject {
 public:
 	MOCK_CONST_METHOD0(getDataFormat, unsigned long());
@@ -41,6 +209,11 @@ public:
 	MOCK_CONST_METHOD1(getTextureID, unsigned int(int textureNumber));
 };
 
+class MockDescribedBatchableObject : public MockBatchableObject {
+public:
+	MOCK_CONST_METHOD1(describe, void(BatchDescriptor& descriptor));
+};
+
 class MockAtlas : public TextureManager::Atlas {
 public:
 	MOCK_METHOD1(willFit, bool(const unsigned long textureId));
@@ -50,6 +223,8 @@ public:
 using ::testing::Return;
 using ::testing::ReturnNull;
 using ::testing::Mock;
+using ::testing::SetArgReferee;
+using ::testing::_;
 
 TEST(BatchCatalogue, IsNotAMatchWhenCheckOnlyAndWhenBatchableObjectFormatDoesNotMatchCatalogue) {
 	BatchCatalogue catalogue(0, false, NULL, NULL, false);
@@ -211,7 +386,7 @@ TEST(BatchCatalogue, IsAMatch_WhenNotCheckOnlyAndBatchableObjectMeetsTheCriteria
 TEST(BatchCatalogue, IsAMatch_WhenNotCheckOnlyAndBatchableObjectMeetsTheCriteriaAndTextureIsNotInTheCatalogueAndAtlasesAreBeingUsed_AndTextureFits) {
 	MockAtlas atlas;
 	EXPECT_CALL(atlas, willFit(2)).WillRepeatedly(Return(true));
-	EXPECT_CALL(atlas, addTexture(2)).WillRepeatedly(ReturnNull());
+	EXPECT_CALL(atlas, addTexture(2)).WillRepeatedly(Return(&kPlacedTexture));
 
 	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0;
 
@@ -231,7 +406,7 @@ TEST(BatchCatalogue, IsAMatch_WhenNotCheckOnlyAndBatchableObjectMeetsTheCriteria
 TEST(BatchCatalogue, IsAMatch_WhenTextureFitsInAtlasAndTextureUnit0IsUsed) {
 	MockAtlas atlas;
 	EXPECT_CALL(atlas, willFit(2)).WillRepeatedly(Return(true));
-	EXPECT_CALL(atlas, addTexture(2)).WillRepeatedly(ReturnNull());
+	EXPECT_CALL(atlas, addTexture(2)).WillRepeatedly(Return(&kPlacedTexture));
 
 	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0;
 
@@ -252,14 +427,17 @@ TEST(BatchCatalogue, IsAMatch_WhenTextureFitsInAtlasAndTextureUnit0IsUsed) {
 TEST(BatchCatalogue, IsAMatch_WhenTextureFitsInAtlasAndAllTextureUnitsUsedWithDataFormat) {
 	MockAtlas atlas0;
 	EXPECT_CALL(atlas0, willFit(2)).WillRepeatedly(Return(true));
-	EXPECT_CALL(atlas0, addTexture(2)).WillRepeatedly(ReturnNull());
+	EXPECT_CALL(atlas0, addTexture(2)).WillRepeatedly(Return(&kPlacedTexture));
 
 	MockAtlas atlas1;
-	EXPECT_CALL(atlas1, addTexture(3)).WillRepeatedly(ReturnNull());
+	EXPECT_CALL(atlas1, willFit(3)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas1, addTexture(3)).WillRepeatedly(Return(&kPlacedTexture));
 	MockAtlas atlas2;
-	EXPECT_CALL(atlas2, addTexture(4)).WillRepeatedly(ReturnNull());
+	EXPECT_CALL(atlas2, willFit(4)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas2, addTexture(4)).WillRepeatedly(Return(&kPlacedTexture));
 	MockAtlas atlas3;
-	EXPECT_CALL(atlas3, addTexture(5)).WillRepeatedly(ReturnNull());
+	EXPECT_CALL(atlas3, willFit(5)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas3, addTexture(5)).WillRepeatedly(Return(&kPlacedTexture));
 
 	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0 + BufferedBatch::kFormatUsesTextureUnit1 + BufferedBatch::kFormatUsesTextureUnit2 + BufferedBatch::kFormatUsesTextureUnit3;
 
@@ -319,7 +497,7 @@ TEST(BatchCatalogue, IsAMatch_WhenTextureFitsInAtlasAndAllTextureUnitsUsedWithou
 TEST(BatchCatalogue, IsAMatch_WhenTextureFitsInAtlasAndAllTextureUnitsUsedWithDataFormatButNullAtlases) {
 	MockAtlas atlas0;
 	EXPECT_CALL(atlas0, willFit(2)).WillRepeatedly(Return(true));
-	EXPECT_CALL(atlas0, addTexture(2));
+	EXPECT_CALL(atlas0, addTexture(2)).WillOnce(Return(&kPlacedTexture));
 
 	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0 + BufferedBatch::kFormatUsesTextureUnit1 + BufferedBatch::kFormatUsesTextureUnit2 + BufferedBatch::kFormatUsesTextureUnit3;;
 
@@ -340,6 +518,2012 @@ TEST(BatchCatalogue, IsAMatch_WhenTextureFitsInAtlasAndAllTextureUnitsUsedWithDa
 	Mock::VerifyAndClearExpectations(&atlas0);
 }
 
+TEST(BatchKey, IsEqualForObjectsThatShareFormatStaticShadersAndIndicies) {
+	ShaderObject vShader;
+	ShaderObject fShader;
+
+	EXPECT_EQ(BatchKey(1, true, &vShader, &fShader, true), BatchKey(1, true, &vShader, &fShader, true));
+}
+
+TEST(BatchKey, DiffersWhenAnyEligibilityFieldDiffers) {
+	ShaderObject vShader;
+	ShaderObject fShader;
+	BatchKey key(1, true, &vShader, &fShader, true);
+
+	EXPECT_NE(key, BatchKey(2, true, &vShader, &fShader, true));
+	EXPECT_NE(key, BatchKey(1, false, &vShader, &fShader, true));
+	EXPECT_NE(key, BatchKey(1, true, &fShader, &fShader, true));
+	EXPECT_NE(key, BatchKey(1, true, &vShader, &vShader, true));
+	EXPECT_NE(key, BatchKey(1, true, &vShader, &fShader, false));
+	EXPECT_NE(key, BatchKey(1, true, NULL, &fShader, true));
+}
+
+TEST(BatchKey, FormatsWithBitsPastThirtyOneAreNeverEligible) {
+	if (sizeof(unsigned long) <= 4) {
+		return;
+	}
+	const unsigned long highFormat = (unsigned long)1 << 20 << 20;
+	BatchKey key(highFormat | 1, false, NULL, NULL, false);
+	EXPECT_FALSE(key.isBatchable());
+	EXPECT_TRUE(BatchKey(1, false, NULL, NULL, false).isBatchable());
+	EXPECT_NE(key, BatchKey(1, false, NULL, NULL, false));
+
+	BatchCatalogue catalogue(highFormat | 1, false, NULL, NULL, false);
+	EXPECT_FALSE(catalogue.isEligible(key));
+	EXPECT_FALSE(BatchCatalogue(1, false, NULL, NULL, false).isEligible(key));
+
+	BatchDescriptor descriptor = { highFormat | 1, false, NULL, NULL, false, { 1, 0, 0, 0 } };
+	uint8_t result = 1;
+	EXPECT_EQ(catalogue.matchBatch(&descriptor, 1, &result, true), 0);
+	EXPECT_EQ(result, 0);
+
+	BatchCatalogueRegistry registry;
+	EXPECT_TRUE(registry.catalogueFor(descriptor) == NULL);
+	EXPECT_EQ(registry.size(), 0);
+}
+
+TEST(ShaderProgramTable, HandsOutNoProgramOnceFullInsteadOfWrapping) {
+	ShaderProgramTable table;
+	const ShaderObject* first = reinterpret_cast<const ShaderObject*>((uintptr_t)16);
+	for (size_t program = table.size(); program < ShaderProgramTable::kMaxPrograms; ++program) {
+		const ShaderObject* vShader = reinterpret_cast<const ShaderObject*>((uintptr_t)(program * 16));
+		ASSERT_EQ(table.intern(vShader, NULL), program);
+	}
+
+	const ShaderObject* extra = reinterpret_cast<const ShaderObject*>((uintptr_t)(ShaderProgramTable::kMaxPrograms * 16));
+	EXPECT_EQ(table.intern(extra, NULL), ShaderProgramTable::kNoProgram);
+	EXPECT_EQ(table.intern(extra, extra), ShaderProgramTable::kNoProgram);
+	EXPECT_EQ(table.size(), ShaderProgramTable::kMaxPrograms);
+	EXPECT_EQ(table.intern(NULL, NULL), 0);
+	EXPECT_EQ(table.intern(first, NULL), 1);
+	EXPECT_TRUE(table.vertexShader(ShaderProgramTable::kNoProgram) == NULL);
+
+	EXPECT_FALSE(BatchKey(0, false, ShaderProgramTable::kNoProgram, false).isBatchable());
+	EXPECT_NE(BatchKey(0, false, ShaderProgramTable::kNoProgram, false), BatchKey(0, false, (unsigned short)0, false));
+}
+
+TEST(ShaderProgramTable, LooksUpAnUnknownPairWithoutInterningIt) {
+	ShaderObject vShader;
+	ShaderObject fShader;
+	const size_t programs = ShaderProgramTable::shared().size();
+
+	BatchDescriptor descriptor = { 0, false, &vShader, &fShader, false, { 1, 0, 0, 0 } };
+	EXPECT_FALSE(BatchKey::forDescriptor(descriptor).isBatchable());
+	BatchCatalogue catalogue(0, false, NULL, NULL, false);
+	EXPECT_FALSE(catalogue.isEligible(descriptor));
+	EXPECT_EQ(ShaderProgramTable::shared().find(&vShader, &fShader), ShaderProgramTable::kNoProgram);
+	EXPECT_EQ(ShaderProgramTable::shared().size(), programs);
+
+	BatchCatalogueRegistry registry;
+	BatchCatalogue* opened = registry.catalogueFor(descriptor);
+	ASSERT_TRUE(opened != NULL);
+	EXPECT_EQ(ShaderProgramTable::shared().size(), programs + 1);
+	EXPECT_EQ(BatchKey::forDescriptor(descriptor), opened->getKey());
+	EXPECT_EQ(registry.catalogueFor(descriptor), opened);
+}
+
+TEST(BatchCatalogue, IsEligibleWhenPrecomputedObjectKeyMatchesCatalogueKey) {
+	ShaderObject vShader;
+	BatchCatalogue catalogue(0, false, &vShader, NULL, false);
+
+	MockBatchableObject batchableObject;
+	EXPECT_CALL(batchableObject, getDataFormat()).WillRepeatedly(Return(0));
+	EXPECT_CALL(batchableObject, isStatic()).WillRepeatedly(Return(false));
+	EXPECT_CALL(batchableObject, getVertexShader()).WillRepeatedly(Return(&vShader));
+	EXPECT_CALL(batchableObject, getFragmentShader()).WillRepeatedly(ReturnNull());
+	EXPECT_CALL(batchableObject, hasIndicies()).WillRepeatedly(Return(false));
+
+	BatchKey key = BatchKey::forObject(&batchableObject);
+	EXPECT_TRUE(catalogue.isEligible(key));
+	EXPECT_FALSE(BatchCatalogue(0, false, NULL, NULL, false).isEligible(key));
+}
+
+TEST(BatchCatalogue, IsAMatch_WhenDescriptorMeetsTheCriteriaAndTextureFitsInAllTextureUnits) {
+	MockAtlas atlas0;
+	EXPECT_CALL(atlas0, willFit(2)).WillOnce(Return(true));
+	EXPECT_CALL(atlas0, addTexture(2)).WillOnce(Return(&kPlacedTexture));
+	MockAtlas atlas1;
+	EXPECT_CALL(atlas1, willFit(3)).WillOnce(Return(true));
+	EXPECT_CALL(atlas1, addTexture(3)).WillOnce(Return(&kPlacedTexture));
+
+	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0 + BufferedBatch::kFormatUsesTextureUnit1;
+
+	BatchCatalogueWithAtlas catalogue(dataFormat, false, NULL, NULL, false, &atlas0, &atlas1, NULL, NULL);
+
+	BatchDescriptor descriptor = { dataFormat, false, NULL, NULL, false, { 2, 3, 0, 0 } };
+
+	EXPECT_TRUE(catalogue.isMatch(descriptor, false));
+	EXPECT_TRUE(catalogue.isMatch(descriptor, false));
+}
+
+class MockRollbackAtlas : public MockAtlas {
+public:
+	MOCK_METHOD1(rollback, void(const unsigned long textureId));
+};
+
+TEST(BatchCatalogue, IsNotAMatch_AndRollsBackTheRemainingUnits_WhenACommitReturnsNull) {
+	MockAtlas atlas0;
+	EXPECT_CALL(atlas0, willFit(2)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas0, addTexture(2)).WillOnce(ReturnNull()).WillOnce(Return(&kPlacedTexture));
+	MockRollbackAtlas atlas1;
+	EXPECT_CALL(atlas1, willFit(3)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas1, rollback(3)).Times(1);
+	EXPECT_CALL(atlas1, addTexture(3)).Times(0);
+
+	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0 + BufferedBatch::kFormatUsesTextureUnit1;
+
+	BatchCatalogueWithAtlas catalogue(dataFormat, false, NULL, NULL, false, &atlas0, &atlas1, NULL, NULL);
+
+	BatchDescriptor descriptor = { dataFormat, false, NULL, NULL, false, { 2, 3, 0, 0 } };
+
+	EXPECT_FALSE(catalogue.isMatch(descriptor, false));
+	Mock::VerifyAndClearExpectations(&atlas1);
+	// Not in the catalogue, so the next placement goes to the atlases again.
+	EXPECT_CALL(atlas1, willFit(3)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas1, addTexture(3)).WillOnce(Return(&kPlacedTexture));
+	EXPECT_TRUE(catalogue.isMatch(descriptor, false));
+}
+
+TEST(BatchCatalogue, ReleasesAndRemovesTheUnitsItCommitted_WhenALaterCommitReturnsNull) {
+	StubTextureSource source;
+	source.addTexture(2, 32, 32);
+	MaxRectsAtlas packed(&source, 64, 64);
+	LruAtlas atlas0(&packed);
+	MockAtlas atlas1;
+	EXPECT_CALL(atlas1, willFit(3)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas1, addTexture(3)).WillOnce(ReturnNull());
+
+	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0 + BufferedBatch::kFormatUsesTextureUnit1;
+	BatchCatalogueWithAtlas catalogue(dataFormat, false, NULL, NULL, false, &atlas0, &atlas1, NULL, NULL);
+	BatchDescriptor descriptor = { dataFormat, false, NULL, NULL, false, { 2, 3, 0, 0 } };
+
+	EXPECT_FALSE(catalogue.isMatch(descriptor, false));
+	EXPECT_EQ(atlas0.references(2), 0);
+	EXPECT_TRUE(packed.find(2) == NULL);
+	EXPECT_EQ(atlas0.textureCount(), 0);
+}
+
+TEST(BatchCatalogue, IsAMatch_MakesASingleDescribeCallWhenNotCheckOnly) {
+	BatchCatalogueWithStubTexture catalogue(0, false, NULL, NULL, false);
+
+	BatchDescriptor descriptor = { 0, false, NULL, NULL, false, { 2, 0, 0, 0 } };
+
+	MockDescribedBatchableObject batchableObject;
+	EXPECT_CALL(batchableObject, describe(_)).WillOnce(SetArgReferee<0>(descriptor));
+	EXPECT_CALL(batchableObject, getDataFormat()).Times(0);
+	EXPECT_CALL(batchableObject, getTextureID(_)).Times(0);
+
+	EXPECT_TRUE(catalogue.isMatch(&batchableObject, false));
+	EXPECT_EQ(catalogue.getTextures().size(), 1);
+	EXPECT_EQ(catalogue.getTextures()[0], 2);
+}
+
+TEST(BatchCatalogueRegistry, ReusesTheCatalogueForObjectsWithTheSameKey) {
+	BatchCatalogueRegistry registry;
+
+	BatchDescriptor first = { 0, false, NULL, NULL, false, { 1, 0, 0, 0 } };
+	BatchDescriptor second = { 0, false, NULL, NULL, false, { 2, 0, 0, 0 } };
+
+	BatchCatalogue* catalogue = registry.catalogueFor(first);
+	EXPECT_EQ(catalogue, registry.catalogueFor(second));
+	EXPECT_EQ(registry.size(), 1);
+}
+
+TEST(BatchCatalogueRegistry, CreatesACatalogueForEachDistinctKey) {
+	BatchCatalogueRegistry registry;
+
+	for (unsigned long format = 0; format < 200; ++format) {
+		BatchDescriptor descriptor = { format, false, NULL, NULL, false, { 1, 0, 0, 0 } };
+		EXPECT_TRUE(registry.catalogueFor(descriptor)->isEligible(descriptor));
+	}
+	for (unsigned long format = 0; format < 200; ++format) {
+		BatchDescriptor descriptor = { format, false, NULL, NULL, false, { 1, 0, 0, 0 } };
+		EXPECT_EQ(registry.at(format), registry.catalogueFor(descriptor));
+	}
+	EXPECT_EQ(registry.size(), 200);
+}
+
+TEST(BatchCatalogueRegistry, StartsANewCatalogueWhenTheTextureDoesNotFitAnyEligibleCatalogue) {
+	MockAtlas atlas;
+	EXPECT_CALL(atlas, willFit(1)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas, willFit(2)).WillOnce(Return(false)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas, addTexture(_)).WillRepeatedly(Return(&kPlacedTexture));
+
+	BatchCatalogueRegistryWithAtlas registry(&atlas);
+
+	BatchDescriptor first = { BufferedBatch::kFormatUsesTextureUnit0, false, NULL, NULL, false, { 1, 0, 0, 0 } };
+	BatchDescriptor second = { BufferedBatch::kFormatUsesTextureUnit0, false, NULL, NULL, false, { 2, 0, 0, 0 } };
+
+	BatchCatalogue* catalogue = registry.catalogueFor(first);
+	EXPECT_NE(catalogue, registry.catalogueFor(second));
+	EXPECT_EQ(registry.size(), 2);
+	EXPECT_EQ(catalogue, registry.catalogueFor(first));
+}
+
+TEST(BatchCatalogueRegistry, KeepsNoCatalogueForAnObjectThatCannotBePlaced) {
+	MockAtlas atlas;
+	EXPECT_CALL(atlas, willFit(3)).WillRepeatedly(Return(false));
+
+	BatchCatalogueRegistryWithAtlas registry(&atlas);
+	BatchDescriptor oversized = { BufferedBatch::kFormatUsesTextureUnit0, false, NULL, NULL, false, { 3, 0, 0, 0 } };
+
+	EXPECT_TRUE(registry.catalogueFor(oversized) == NULL);
+	EXPECT_TRUE(registry.catalogueFor(oversized) == NULL);
+	EXPECT_EQ(registry.size(), 0);
+}
+
+TEST(TextureIdSet, ContainsOnlyInsertedIdsAcrossTheSwitchToAHashIndex) {
+	TextureIdSet textures;
+
+	for (unsigned int textureId = 0; textureId < 500; textureId += 5) {
+		EXPECT_TRUE(textures.insert(textureId));
+		EXPECT_FALSE(textures.insert(textureId));
+	}
+
+	EXPECT_EQ(textures.size(), 100);
+	for (unsigned int textureId = 0; textureId < 500; ++textureId) {
+		EXPECT_EQ(textures.contains(textureId), textureId % 5 == 0);
+	}
+	EXPECT_EQ(textures.ids().size(), 100);
+}
+
+TEST(TextureIdSet, InsertAtUsesTheSlotFromAFailedLookup) {
+	TextureIdSet textures;
+
+	for (unsigned int textureId = 1; textureId < 100; ++textureId) {
+		bool found;
+		size_t slot = textures.lookup(textureId * 7919, found);
+		EXPECT_FALSE(found);
+		textures.insertAt(slot, textureId * 7919);
+		textures.lookup(textureId * 7919, found);
+		EXPECT_TRUE(found);
+	}
+}
+
+TEST(TextureIdSet, LookupsDoNotInternIdsAndTheRegistryForgetsIdsOnceNoSetHoldsThem) {
+	TextureRegistry& registry = TextureRegistry::shared();
+	const size_t before = registry.size();
+	{
+		TextureIdSet textures;
+		for (unsigned int textureId = 0; textureId <= TextureIdSet::kLinearLimit; ++textureId) {
+			textures.insert(4000000 + textureId);
+		}
+		const size_t interned = registry.size();
+
+		bool found;
+		for (unsigned int textureId = 5000000; textureId < 5000100; ++textureId) {
+			textures.lookup(textureId, found);
+			EXPECT_FALSE(found);
+			EXPECT_FALSE(textures.contains(textureId));
+		}
+		EXPECT_EQ(registry.size(), interned);
+
+		size_t slot = textures.lookup(6000000, found);
+		textures.insertAt(slot, 6000000);
+		EXPECT_TRUE(textures.contains(6000000));
+		EXPECT_EQ(registry.size(), interned + 1);
+
+		TextureIdSet copy(textures);
+		textures.clear();
+		EXPECT_EQ(registry.size(), interned + 1);
+		EXPECT_TRUE(copy.contains(6000000));
+	}
+	unsigned int index;
+	EXPECT_FALSE(registry.find(6000000, index));
+	EXPECT_EQ(registry.size(), before);
+}
+
+TEST(TextureRegistry, ReusesTheIndicesOfReleasedIds) {
+	TextureRegistry registry;
+
+	for (unsigned int round = 0; round < 100; ++round) {
+		std::vector<unsigned int> indices;
+		for (unsigned int textureId = 0; textureId < 600; ++textureId) {
+			indices.push_back(registry.intern(round * 1000 + textureId));
+		}
+		for (size_t i = 0; i < indices.size(); ++i) {
+			EXPECT_LT(indices[i], 600);
+			EXPECT_EQ(registry.textureIdAt(indices[i]), round * 1000 + i);
+		}
+		for (size_t i = 0; i < indices.size(); i += 2) {
+			registry.release(indices[i]);
+		}
+		unsigned int index;
+		EXPECT_FALSE(registry.find(round * 1000, index));
+		EXPECT_TRUE(registry.find(round * 1000 + 1, index));
+		EXPECT_EQ(index, indices[1]);
+		for (size_t i = 1; i < indices.size(); i += 2) {
+			registry.release(indices[i]);
+		}
+		EXPECT_EQ(registry.size(), 0);
+	}
+}
+
+TEST(TextureRegistry, InternsSparseIdsIntoDenseIndicesInFirstSeenOrder) {
+	TextureRegistry registry;
+
+	EXPECT_EQ(registry.intern(90210), 0);
+	EXPECT_EQ(registry.intern(7), 1);
+	EXPECT_EQ(registry.intern(90210), 0);
+	for (unsigned int textureId = 1000; textureId < 3000; ++textureId) {
+		EXPECT_EQ(registry.intern(textureId), textureId - 998);
+	}
+
+	unsigned int index;
+	EXPECT_TRUE(registry.find(7, index));
+	EXPECT_EQ(index, 1);
+	EXPECT_FALSE(registry.find(8, index));
+	EXPECT_EQ(registry.textureIdAt(2001), 2999);
+	EXPECT_EQ(registry.size(), 2002);
+}
+
+TEST(TextureBitset, WalksSetIndicesInOrder) {
+	TextureBitset bits;
+	bits.set(3);
+	bits.set(64);
+	bits.set(200);
+
+	EXPECT_TRUE(bits.test(3));
+	EXPECT_FALSE(bits.test(65));
+	EXPECT_FALSE(bits.test(100000));
+	EXPECT_EQ(bits.next(0), 3);
+	EXPECT_EQ(bits.next(4), 64);
+	EXPECT_EQ(bits.next(65), 200);
+	EXPECT_EQ(bits.next(201), bits.end());
+}
+
+TEST(ShaderProgramTable, InternsEachShaderPairOnceWithNullPairAsProgramZero) {
+	ShaderProgramTable table;
+	ShaderObject vShader;
+	ShaderObject fShader;
+
+	EXPECT_EQ(table.intern(NULL, NULL), 0);
+	unsigned short program = table.intern(&vShader, &fShader);
+	EXPECT_NE(program, 0);
+	EXPECT_EQ(table.intern(&vShader, &fShader), program);
+	EXPECT_NE(table.intern(&fShader, &vShader), program);
+	EXPECT_EQ(table.vertexShader(program), &vShader);
+	EXPECT_EQ(table.fragmentShader(program), &fShader);
+	EXPECT_EQ(table.size(), 3);
+}
+
+TEST(BatchCatalogueRegistry, SortByProgramGroupsCataloguesSharingShaders) {
+	ShaderObject first;
+	ShaderObject second;
+	BatchCatalogueRegistry registry;
+
+	BatchDescriptor descriptors[] = {
+		{ 0, false, &second, NULL, false, { 1, 0, 0, 0 } },
+		{ 0, false, &first, NULL, false, { 1, 0, 0, 0 } },
+		{ 1, false, &second, NULL, false, { 1, 0, 0, 0 } },
+		{ 1, false, &first, NULL, false, { 1, 0, 0, 0 } }
+	};
+	for (size_t i = 0; i < 4; ++i) {
+		registry.catalogueFor(descriptors[i]);
+	}
+
+	registry.sortByProgram();
+	EXPECT_EQ(registry.at(0)->getKey().programId(), registry.at(1)->getKey().programId());
+	EXPECT_EQ(registry.at(2)->getKey().programId(), registry.at(3)->getKey().programId());
+	EXPECT_NE(registry.at(1)->getKey().programId(), registry.at(2)->getKey().programId());
+}
+
+TEST(BatchCatalogue, MatchBatch_ClassifiesAndAddsARunOfDescriptors) {
+	MockAtlas atlas;
+	EXPECT_CALL(atlas, willFit(1)).WillOnce(Return(true));
+	EXPECT_CALL(atlas, willFit(2)).WillOnce(Return(false));
+	EXPECT_CALL(atlas, addTexture(1)).WillOnce(Return(&kPlacedTexture));
+
+	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0;
+	ShaderObject vShader;
+
+	BatchCatalogueWithAtlas catalogue(dataFormat, false, &vShader, NULL, false, &atlas, NULL, NULL, NULL);
+
+	BatchDescriptor descriptors[] = {
+		{ dataFormat, false, &vShader, NULL, false, { 1, 0, 0, 0 } },
+		{ dataFormat, false, NULL, NULL, false, { 1, 0, 0, 0 } },
+		{ dataFormat, false, &vShader, NULL, false, { 2, 0, 0, 0 } },
+		{ dataFormat, true, &vShader, NULL, false, { 1, 0, 0, 0 } },
+		{ dataFormat, false, &vShader, NULL, false, { 1, 0, 0, 0 } }
+	};
+	uint8_t results[5];
+
+	EXPECT_EQ(catalogue.matchBatch(descriptors, 5, results, false), 2);
+	EXPECT_EQ(results[0], 1);
+	EXPECT_EQ(results[1], 0);
+	EXPECT_EQ(results[2], 0);
+	EXPECT_EQ(results[3], 0);
+	EXPECT_EQ(results[4], 1);
+}
+
+TEST(BatchCatalogue, MatchBatch_DescribesEachObjectOnceWhenNotCheckOnly) {
+	BatchCatalogueWithStubTexture catalogue(0, false, NULL, NULL, false);
+
+	BatchDescriptor matching = { 0, false, NULL, NULL, false, { 2, 0, 0, 0 } };
+	BatchDescriptor notMatching = { 1, false, NULL, NULL, false, { 3, 0, 0, 0 } };
+
+	const size_t count = 100;
+	MockDescribedBatchableObject objects[count];
+	const BatchableObject* pointers[count];
+	for (size_t i = 0; i < count; ++i) {
+		EXPECT_CALL(objects[i], describe(_)).WillOnce(SetArgReferee<0>(i % 2 ? notMatching : matching));
+		pointers[i] = &objects[i];
+	}
+	uint8_t results[count];
+
+	EXPECT_EQ(catalogue.matchBatch(pointers, count, results, false), 50);
+	EXPECT_EQ(results[98], 1);
+	EXPECT_EQ(results[99], 0);
+	EXPECT_EQ(catalogue.getTextures().size(), 1);
+}
+
+TEST(BatchKeyArray, SetsOneMaskBitPerMatchingKey) {
+	ShaderObject vShader;
+	BatchKeyArray keys;
+
+	const size_t count = 131;
+	for (size_t i = 0; i < count; ++i) {
+		keys.push_back(BatchKey(i % 3, false, i % 5 ? &vShader : NULL, NULL, false));
+	}
+
+	std::vector<uint64_t> mask(keys.maskWords());
+	EXPECT_EQ(mask.size(), 3);
+	EXPECT_EQ(keys.matching(BatchKey(1, false, &vShader, NULL, false), &mask[0]), 35);
+
+	for (size_t i = 0; i < count; ++i) {
+		bool expected = i % 3 == 1 && i % 5 != 0;
+		EXPECT_EQ((mask[i / 64] >> (i % 64)) & 1, expected ? 1U : 0U);
+	}
+	EXPECT_EQ(mask[2] >> 3, 0);
+}
+
+TEST(BatchCatalogue, FilterEligibleMatchesIsEligibleForEachKey) {
+	BatchCatalogue catalogue(2, true, NULL, NULL, true);
+	BatchKeyArray keys;
+	keys.push_back(BatchKey(2, true, NULL, NULL, true));
+	keys.push_back(BatchKey(2, false, NULL, NULL, true));
+	keys.push_back(BatchKey(2, true, NULL, NULL, true));
+
+	uint64_t mask;
+	EXPECT_EQ(catalogue.filterEligible(keys, &mask), 2);
+	EXPECT_EQ(mask, 5);
+}
+
+TEST(SortedBatchAssigner, BuildsTheSameCataloguesAsThePerObjectPathWhenEverythingFits) {
+	ShaderObject shaders[3];
+	std::vector<BatchDescriptor> descriptors;
+	unsigned int seed = 12345;
+	for (size_t i = 0; i < 2000; ++i) {
+		seed = seed * 1103515245 + 12345;
+		BatchDescriptor descriptor = { (seed >> 8) % 4, (seed >> 12) % 2 == 0, &shaders[(seed >> 16) % 3], NULL, false, { (seed >> 20) % 50, 0, 0, 0 } };
+		descriptors.push_back(descriptor);
+	}
+
+	BatchCatalogueRegistryWithStubTexture perObject;
+	std::vector<BatchCatalogue*> expected(descriptors.size());
+	for (size_t i = 0; i < descriptors.size(); ++i) {
+		expected[i] = perObject.catalogueFor(descriptors[i]);
+	}
+
+	BatchCatalogueRegistryWithStubTexture sorted;
+	SortedBatchAssigner assigner(sorted);
+	std::vector<BatchCatalogue*> actual(descriptors.size());
+	EXPECT_EQ(assigner.assign(&descriptors[0], descriptors.size(), &actual[0]), descriptors.size());
+
+	EXPECT_EQ(sorted.size(), perObject.size());
+	for (size_t i = 0; i < descriptors.size(); ++i) {
+		EXPECT_EQ(actual[i]->getKey(), expected[i]->getKey());
+		EXPECT_EQ(sorted.getTextures(actual[i]), perObject.getTextures(expected[i]));
+	}
+}
+
+TEST(SortedBatchAssigner, OpensANewCatalogueWhenTheAtlasRejectsATexture) {
+	MockAtlas atlas;
+	EXPECT_CALL(atlas, willFit(1)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas, willFit(2)).WillOnce(Return(false)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas, addTexture(_)).WillRepeatedly(Return(&kPlacedTexture));
+
+	BatchCatalogueRegistryWithAtlas registry(&atlas);
+	SortedBatchAssigner assigner(registry);
+
+	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0;
+	BatchDescriptor descriptors[] = {
+		{ dataFormat, false, NULL, NULL, false, { 2, 0, 0, 0 } },
+		{ dataFormat, false, NULL, NULL, false, { 1, 0, 0, 0 } },
+		{ dataFormat, false, NULL, NULL, false, { 1, 0, 0, 0 } }
+	};
+	BatchCatalogue* assignments[3];
+
+	EXPECT_EQ(assigner.assign(descriptors, 3, assignments), 3);
+	EXPECT_EQ(registry.size(), 2);
+	EXPECT_EQ(assignments[1], assignments[2]);
+	EXPECT_NE(assignments[0], assignments[1]);
+}
+
+TEST(SortedBatchAssigner, TriesATextureThatNeverFitsOnceAndKeepsFillingTheCatalogue) {
+	MockAtlas atlas;
+	EXPECT_CALL(atlas, willFit(1)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas, willFit(7)).Times(2).WillRepeatedly(Return(false));
+	EXPECT_CALL(atlas, willFit(8)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas, addTexture(_)).WillRepeatedly(Return(&kPlacedTexture));
+
+	BatchCatalogueRegistryWithAtlas registry(&atlas);
+	SortedBatchAssigner assigner(registry);
+
+	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0;
+	std::vector<BatchDescriptor> descriptors;
+	BatchDescriptor first = { dataFormat, false, NULL, NULL, false, { 1, 0, 0, 0 } };
+	BatchDescriptor oversized = { dataFormat, false, NULL, NULL, false, { 7, 0, 0, 0 } };
+	BatchDescriptor last = { dataFormat, false, NULL, NULL, false, { 8, 0, 0, 0 } };
+	descriptors.push_back(first);
+	descriptors.insert(descriptors.end(), 5, oversized);
+	descriptors.push_back(last);
+	std::vector<BatchCatalogue*> assignments(descriptors.size());
+
+	EXPECT_EQ(assigner.assign(&descriptors[0], descriptors.size(), &assignments[0]), 2);
+	EXPECT_EQ(registry.size(), 1);
+	EXPECT_TRUE(assignments[0] != NULL);
+	EXPECT_TRUE(assignments[3] == NULL);
+	EXPECT_EQ(assignments[6], assignments[0]);
+}
+
+TEST(ParallelCatalogueBuilder, BuildsTheSameCataloguesForAnyThreadCount) {
+	ShaderObject shaders[2];
+	std::vector<BatchDescriptor> descriptors;
+	unsigned int seed = 777;
+	for (size_t i = 0; i < 5000; ++i) {
+		seed = seed * 1103515245 + 12345;
+		BatchDescriptor descriptor = { BufferedBatch::kFormatUsesTextureUnit0 | ((seed >> 8) % 3), false, &shaders[(seed >> 16) % 2], NULL, false, { (seed >> 20) % 40, 0, 0, 0 } };
+		descriptors.push_back(descriptor);
+	}
+
+	std::vector<size_t> expected;
+	size_t expectedCatalogues = 0;
+	size_t threadCounts[] = { 1, 2, 3, 8 };
+	for (size_t t = 0; t < 4; ++t) {
+		BatchCatalogueRegistryWithCapacity registry(5);
+		ParallelCatalogueBuilder builder(registry, threadCounts[t]);
+		std::vector<BatchCatalogue*> assignments(descriptors.size());
+		EXPECT_EQ(builder.build(&descriptors[0], descriptors.size(), &assignments[0]), descriptors.size());
+
+		std::vector<size_t> actual;
+		for (size_t i = 0; i < assignments.size(); ++i) {
+			EXPECT_TRUE(assignments[i]->isEligible(descriptors[i]));
+			actual.push_back(registry.indexOf(assignments[i]));
+		}
+
+		if (t == 0) {
+			expected = actual;
+			expectedCatalogues = registry.size();
+			EXPECT_EQ(expectedCatalogues, 6 * 8);
+		}
+		EXPECT_EQ(actual, expected);
+		EXPECT_EQ(registry.size(), expectedCatalogues);
+	}
+}
+
+TEST(ParallelCatalogueBuilder, MatchesThePerObjectPathWhenAtlasesArePerCatalogue) {
+	std::vector<BatchDescriptor> descriptors;
+	unsigned int seed = 99;
+	for (size_t i = 0; i < 1000; ++i) {
+		seed = seed * 1103515245 + 12345;
+		BatchDescriptor descriptor = { BufferedBatch::kFormatUsesTextureUnit0 | ((seed >> 8) % 2), false, NULL, NULL, false, { (seed >> 20) % 30, 0, 0, 0 } };
+		descriptors.push_back(descriptor);
+	}
+
+	BatchCatalogueRegistryWithCapacity perObject(4);
+	BatchCatalogueRegistryWithCapacity parallel(4);
+	ParallelCatalogueBuilder builder(parallel, 4);
+	std::vector<BatchCatalogue*> assignments(descriptors.size());
+	builder.build(&descriptors[0], descriptors.size(), &assignments[0]);
+
+	for (size_t i = 0; i < descriptors.size(); ++i) {
+		BatchCatalogue* expected = perObject.catalogueFor(descriptors[i]);
+		EXPECT_EQ(expected->getKey(), assignments[i]->getKey());
+	}
+	EXPECT_EQ(perObject.size(), parallel.size());
+}
+
+TEST(SkylineAtlas, PlacesTexturesUntilThePageIsFullAndReportsUVs) {
+	StubTextureSource source;
+	for (unsigned long textureID = 1; textureID <= 5; ++textureID) {
+		source.addTexture(textureID, 64, 64);
+	}
+	SkylineAtlas atlas(&source, 128, 128);
+
+	std::vector<const AtlasedTexture*> placed;
+	for (unsigned long textureID = 1; textureID <= 4; ++textureID) {
+		EXPECT_TRUE(atlas.willFit(textureID));
+		placed.push_back(atlas.addTexture(textureID));
+		ASSERT_TRUE(placed.back() != NULL);
+	}
+
+	EXPECT_FALSE(atlas.willFit(5));
+	EXPECT_TRUE(atlas.addTexture(5) == NULL);
+	EXPECT_TRUE(atlas.willFit(2));
+	EXPECT_EQ(atlas.addTexture(2), placed[1]);
+	EXPECT_FLOAT_EQ(atlas.occupancy(), 1.0f);
+	expectPackedWithoutOverlaps(placed, 128, 128);
+
+	EXPECT_EQ(placed[0]->x, 0);
+	EXPECT_EQ(placed[0]->y, 0);
+	EXPECT_FLOAT_EQ(placed[1]->u0, 0.5f);
+	EXPECT_FLOAT_EQ(placed[1]->u1, 1.0f);
+	EXPECT_FLOAT_EQ(placed[1]->v1, 0.5f);
+}
+
+TEST(SkylineAtlas, DoesNotFitUnknownOrOversizedTextures) {
+	StubTextureSource source;
+	source.addTexture(1, 300, 10);
+	SkylineAtlas atlas(&source, 256, 256);
+
+	EXPECT_FALSE(atlas.willFit(1));
+	EXPECT_FALSE(atlas.willFit(2));
+}
+
+TEST(SkylineAtlas, PacksManyMixedSizesWithoutOverlap) {
+	StubTextureSource source;
+	unsigned int seed = 4242;
+	for (unsigned long textureID = 0; textureID < 3000; ++textureID) {
+		seed = seed * 1103515245 + 12345;
+		source.addTexture(textureID, 4 + (seed >> 8) % 60, 4 + (seed >> 16) % 60);
+	}
+	SkylineAtlas atlas(&source, 1024, 1024);
+
+	std::vector<const AtlasedTexture*> placed;
+	for (unsigned long textureID = 0; textureID < 3000; ++textureID) {
+		bool fits = atlas.willFit(textureID);
+		const AtlasedTexture* texture = atlas.addTexture(textureID);
+		EXPECT_EQ(fits, texture != NULL);
+		if (texture) {
+			placed.push_back(texture);
+		}
+	}
+
+	EXPECT_GT(atlas.occupancy(), 0.7f);
+	expectPackedWithoutOverlaps(placed, 1024, 1024);
+}
+
+TEST(MaxRectsAtlas, PacksManyMixedSizesWithoutOverlapAndAtLeastAsDenselyAsSkyline) {
+	StubTextureSource source;
+	unsigned int seed = 4242;
+	for (unsigned long textureID = 0; textureID < 1500; ++textureID) {
+		seed = seed * 1103515245 + 12345;
+		source.addTexture(textureID, 4 + (seed >> 8) % 60, 4 + (seed >> 16) % 60);
+	}
+	MaxRectsAtlas atlas(&source, 512, 512);
+	SkylineAtlas skyline(&source, 512, 512);
+
+	std::vector<const AtlasedTexture*> placed;
+	for (unsigned long textureID = 0; textureID < 1500; ++textureID) {
+		bool fits = atlas.willFit(textureID);
+		const AtlasedTexture* texture = atlas.addTexture(textureID);
+		EXPECT_EQ(fits, texture != NULL);
+		if (texture) {
+			placed.push_back(texture);
+		}
+		skyline.addTexture(textureID);
+	}
+
+	expectPackedWithoutOverlaps(placed, 512, 512);
+	EXPECT_GE(atlas.occupancy(), skyline.occupancy());
+}
+
+TEST(MaxRectsAtlas, FillsAPageExactlyWithTilesThatDivideIt) {
+	StubTextureSource source;
+	for (unsigned long textureID = 0; textureID < 17; ++textureID) {
+		source.addTexture(textureID, 32, 32);
+	}
+	MaxRectsAtlas atlas(&source, 128, 128);
+
+	for (unsigned long textureID = 0; textureID < 16; ++textureID) {
+		EXPECT_TRUE(atlas.addTexture(textureID) != NULL);
+	}
+	EXPECT_FALSE(atlas.willFit(16));
+	EXPECT_FLOAT_EQ(atlas.occupancy(), 1.0f);
+}
+
+TEST(BatchCatalogue, IsNotAMatch_AndAddsNothing_WhenAnyUsedTextureUnitIsFull) {
+	StubTextureSource source;
+	source.addTexture(2, 64, 64);
+	source.addTexture(3, 64, 64);
+	source.addTexture(4, 64, 64);
+	source.addTexture(9, 128, 128);
+	SkylineAtlas atlas0(&source, 128, 128);
+	SkylineAtlas atlas1(&source, 128, 128);
+	MockAtlas atlas2;
+	EXPECT_CALL(atlas2, willFit(4)).WillOnce(Return(false));
+	EXPECT_CALL(atlas2, addTexture(_)).Times(0);
+
+	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0 + BufferedBatch::kFormatUsesTextureUnit1 + BufferedBatch::kFormatUsesTextureUnit2;
+
+	BatchCatalogueWithAtlas catalogue(dataFormat, false, NULL, NULL, false, &atlas0, &atlas1, &atlas2, NULL);
+
+	BatchDescriptor descriptor = { dataFormat, false, NULL, NULL, false, { 2, 3, 4, 0 } };
+
+	EXPECT_FALSE(catalogue.isMatch(descriptor, false));
+	EXPECT_EQ(atlas0.textureCount(), 0);
+	EXPECT_EQ(atlas1.textureCount(), 0);
+	EXPECT_TRUE(atlas0.willFit(9));
+	EXPECT_TRUE(atlas1.willFit(9));
+}
+
+TEST(SkylineAtlas, RollingBackReservationsInReverseOrderFreesTheirSpace) {
+	StubTextureSource source;
+	source.addTexture(1, 64, 128);
+	source.addTexture(2, 64, 128);
+	source.addTexture(3, 128, 128);
+	SkylineAtlas atlas(&source, 128, 128);
+
+	EXPECT_TRUE(atlas.reserve(1));
+	EXPECT_TRUE(atlas.reserve(2));
+	EXPECT_FALSE(atlas.reserve(3));
+	atlas.rollback(2);
+	atlas.rollback(1);
+
+	EXPECT_TRUE(atlas.reserve(3));
+	const AtlasedTexture* texture = atlas.commit(3);
+	ASSERT_TRUE(texture != NULL);
+	EXPECT_EQ(texture->width, 128);
+	EXPECT_FALSE(atlas.willFit(1));
+}
+
+TEST(SkylineAtlas, KeepsEarlierReservationsInPlaceWhenALaterOneIsRolledBack) {
+	StubTextureSource source;
+	source.addTexture(1, 64, 64);
+	source.addTexture(2, 64, 64);
+	source.addTexture(3, 64, 64);
+	SkylineAtlas atlas(&source, 128, 64);
+
+	EXPECT_TRUE(atlas.reserve(1));
+	EXPECT_TRUE(atlas.reserve(2));
+	atlas.rollback(2);
+	EXPECT_TRUE(atlas.reserve(3));
+	EXPECT_FALSE(atlas.willFit(2));
+
+	const AtlasedTexture* first = atlas.commit(1);
+	const AtlasedTexture* third = atlas.commit(3);
+	ASSERT_TRUE(first != NULL && third != NULL);
+	EXPECT_FALSE(rectsOverlap(*first, *third));
+	EXPECT_EQ(atlas.textureCount(), 2);
+}
+
+TEST(SkylineAtlas, AllocatesAnotherPageAsTheNextLayerUntilThePageLimit) {
+	StubTextureSource source;
+	source.addTexture(1, 128, 128);
+	source.addTexture(2, 64, 64);
+	source.addTexture(3, 128, 128);
+	source.addTexture(4, 128, 128);
+	SkylineAtlas atlas(&source, 128, 128, 3);
+
+	const AtlasedTexture* first = atlas.addTexture(1);
+	const AtlasedTexture* second = atlas.addTexture(2);
+	ASSERT_TRUE(first != NULL);
+	ASSERT_TRUE(second != NULL);
+	EXPECT_EQ(first->layer, 0);
+	EXPECT_EQ(second->layer, 1);
+	EXPECT_FLOAT_EQ(second->u1, 0.5f);
+	EXPECT_EQ(atlas.pageCount(), 2);
+
+	const AtlasedTexture* third = atlas.addTexture(3);
+	ASSERT_TRUE(third != NULL);
+	EXPECT_EQ(third->layer, 2);
+	EXPECT_FALSE(atlas.willFit(4));
+	EXPECT_TRUE(atlas.addTexture(4) == NULL);
+	EXPECT_EQ(atlas.pageCount(), 3);
+}
+
+TEST(MaxRectsAtlas, RollingBackDropsPagesAllocatedByTheTransaction) {
+	StubTextureSource source;
+	source.addTexture(1, 128, 128);
+	source.addTexture(2, 128, 128);
+	source.addTexture(3, 64, 64);
+	MaxRectsAtlas atlas(&source, 128, 128, 2);
+	atlas.addTexture(1);
+
+	EXPECT_TRUE(atlas.reserve(2));
+	EXPECT_EQ(atlas.pageCount(), 2);
+	atlas.rollback(2);
+	EXPECT_EQ(atlas.pageCount(), 1);
+
+	const AtlasedTexture* texture = atlas.addTexture(3);
+	ASSERT_TRUE(texture != NULL);
+	EXPECT_EQ(texture->layer, 1);
+	EXPECT_FLOAT_EQ(atlas.occupancy(), 1.25f / 2.0f);
+}
+
+TEST(TextureArrayAtlas, GivesEachTextureItsOwnLayerUntilTheArrayIsFull) {
+	StubTextureSource source;
+	source.addTexture(1, 32, 32);
+	source.addTexture(2, 16, 32);
+	source.addTexture(3, 32, 32);
+	source.addTexture(4, 64, 32);
+	TextureArrayAtlas atlas(&source, 32, 32, 2);
+
+	EXPECT_FALSE(atlas.willFit(4));
+	const AtlasedTexture* first = atlas.addTexture(1);
+	const AtlasedTexture* second = atlas.addTexture(2);
+	ASSERT_TRUE(first != NULL);
+	ASSERT_TRUE(second != NULL);
+	EXPECT_EQ(first->layer, 0);
+	EXPECT_EQ(second->layer, 1);
+	EXPECT_FLOAT_EQ(first->u1, 1.0f);
+	EXPECT_FLOAT_EQ(second->u1, 0.5f);
+	EXPECT_EQ(atlas.addTexture(1), first);
+
+	EXPECT_FALSE(atlas.willFit(3));
+	EXPECT_TRUE(atlas.addTexture(3) == NULL);
+}
+
+TEST(TextureArrayAtlas, RollingBackAReservationReturnsItsLayer) {
+	StubTextureSource source;
+	source.addTexture(1, 32, 32);
+	source.addTexture(2, 32, 32);
+	TextureArrayAtlas atlas(&source, 32, 32, 1);
+
+	EXPECT_TRUE(atlas.reserve(1));
+	EXPECT_FALSE(atlas.reserve(2));
+	atlas.rollback(1);
+	EXPECT_EQ(atlas.freeLayerCount(), 1);
+
+	EXPECT_TRUE(atlas.reserve(2));
+	const AtlasedTexture* texture = atlas.commit(2);
+	ASSERT_TRUE(texture != NULL);
+	EXPECT_EQ(texture->layer, 0);
+	EXPECT_EQ(atlas.textureCount(), 1);
+}
+
+TEST(SlabAtlas, PutsTexturesInTheSmallestSizeClassAndCarvesOneSlabPerClass) {
+	StubTextureSource source;
+	source.addTexture(1, 30, 30);
+	source.addTexture(2, 60, 64);
+	source.addTexture(3, 32, 32);
+	source.addTexture(4, 65, 10);
+	SlabAtlas atlas(&source, 128, 128, 64);
+	EXPECT_TRUE(atlas.addSizeClass(64, 64));
+	EXPECT_TRUE(atlas.addSizeClass(32, 32));
+	EXPECT_FALSE(atlas.addSizeClass(128, 32));
+
+	std::vector<const AtlasedTexture*> placed;
+	placed.push_back(atlas.addTexture(1));
+	placed.push_back(atlas.addTexture(2));
+	placed.push_back(atlas.addTexture(3));
+	ASSERT_TRUE(placed[0] != NULL && placed[1] != NULL && placed[2] != NULL);
+	EXPECT_EQ(placed[0]->x, 0);
+	EXPECT_EQ(placed[0]->y, 0);
+	EXPECT_EQ(placed[1]->x, 64);
+	EXPECT_EQ(placed[2]->x, 32);
+	EXPECT_EQ(atlas.freeSlabCount(), 2);
+	EXPECT_FALSE(atlas.willFit(4));
+	expectPackedWithoutOverlaps(placed, 128, 128);
+}
+
+TEST(SlabAtlas, ReusesRemovedCellsSoChurnNeverRunsOutOfSpace) {
+	StubTextureSource source;
+	for (unsigned long textureID = 0; textureID < 1000; ++textureID) {
+		source.addTexture(textureID, 16, 16);
+	}
+	SlabAtlas atlas(&source, 64, 64, 32);
+	atlas.addSizeClass(16, 16);
+
+	for (unsigned long textureID = 0; textureID < 16; ++textureID) {
+		EXPECT_TRUE(atlas.addTexture(textureID) != NULL);
+	}
+	EXPECT_FALSE(atlas.willFit(16));
+
+	for (unsigned long textureID = 16; textureID < 1000; ++textureID) {
+		EXPECT_TRUE(atlas.removeTexture(textureID - 16));
+		EXPECT_TRUE(atlas.willFit(textureID));
+		EXPECT_TRUE(atlas.addTexture(textureID) != NULL);
+	}
+	EXPECT_EQ(atlas.textureCount(), 16);
+	EXPECT_FALSE(atlas.removeTexture(0));
+}
+
+TEST(SlabAtlas, GivesAnEmptiedSlabBackForAnyClassToUse) {
+	StubTextureSource source;
+	for (unsigned long textureID = 0; textureID < 8; ++textureID) {
+		source.addTexture(textureID, 32, 32);
+	}
+	source.addTexture(100, 64, 64);
+	SlabAtlas atlas(&source, 128, 64, 64);
+	atlas.addSizeClass(32, 32);
+	atlas.addSizeClass(64, 64);
+
+	for (unsigned long textureID = 0; textureID < 8; ++textureID) {
+		ASSERT_TRUE(atlas.addTexture(textureID) != NULL);
+	}
+	EXPECT_EQ(atlas.freeSlabCount(), 0);
+	EXPECT_FALSE(atlas.willFit(100));
+
+	const unsigned int slabX = atlas.find(0)->x / 64 * 64;
+	std::vector<unsigned long> sameSlab;
+	for (unsigned long textureID = 0; textureID < 8; ++textureID) {
+		if (atlas.find(textureID)->x / 64 * 64 == slabX) {
+			sameSlab.push_back(textureID);
+		}
+	}
+	ASSERT_EQ(sameSlab.size(), 4);
+	EXPECT_FALSE(atlas.fitsWithout(100, std::vector<unsigned long>(sameSlab.begin(), sameSlab.begin() + 3)));
+	EXPECT_TRUE(atlas.fitsWithout(100, sameSlab));
+
+	for (size_t i = 0; i < sameSlab.size(); ++i) {
+		EXPECT_TRUE(atlas.removeTexture(sameSlab[i]));
+	}
+	EXPECT_EQ(atlas.freeSlabCount(), 1);
+	const AtlasedTexture* large = atlas.addTexture(100);
+	ASSERT_TRUE(large != NULL);
+	EXPECT_EQ(large->x, slabX);
+	EXPECT_FALSE(atlas.willFit(sameSlab[0]));
+}
+
+TEST(SlabAtlas, RefusesNewSizeClassesWhileAReservationIsHeld) {
+	StubTextureSource source;
+	source.addTexture(1, 30, 30);
+	SlabAtlas atlas(&source, 128, 128, 64);
+	EXPECT_TRUE(atlas.addSizeClass(32, 32));
+
+	EXPECT_TRUE(atlas.reserve(1));
+	EXPECT_FALSE(atlas.addSizeClass(16, 16));
+	atlas.rollback(1);
+	EXPECT_TRUE(atlas.addSizeClass(16, 16));
+
+	EXPECT_TRUE(atlas.reserve(1));
+	const AtlasedTexture* texture = atlas.commit(1);
+	ASSERT_TRUE(texture != NULL);
+	EXPECT_EQ(texture->width, 30);
+	EXPECT_TRUE(atlas.removeTexture(1));
+	EXPECT_EQ(atlas.sizeClassCount(), 2);
+}
+
+TEST(BatchCatalogue, RetainsEveryTextureItPlacesAndReleasesThemWhenDestroyed) {
+	StubTextureSource source;
+	source.addTexture(1, 32, 32);
+	source.addTexture(2, 32, 32);
+	source.addTexture(5, 32, 32);
+	SkylineAtlas atlas0(&source, 128, 128);
+	SkylineAtlas atlas1(&source, 128, 128);
+	LruAtlas lru0(&atlas0);
+	LruAtlas lru1(&atlas1);
+
+	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0 + BufferedBatch::kFormatUsesTextureUnit1;
+	BatchDescriptor first = { dataFormat, false, NULL, NULL, false, { 1, 5, 0, 0 } };
+	BatchDescriptor second = { dataFormat, false, NULL, NULL, false, { 2, 5, 0, 0 } };
+	{
+		BatchCatalogueWithAtlas catalogue(dataFormat, false, NULL, NULL, false, &lru0, &lru1, NULL, NULL);
+		EXPECT_TRUE(catalogue.isMatch(first, false));
+		EXPECT_TRUE(catalogue.isMatch(first, false));
+		catalogue.addToCatalogue(second);
+
+		EXPECT_EQ(lru0.references(1), 1);
+		EXPECT_EQ(lru0.references(2), 1);
+		EXPECT_EQ(lru1.references(5), 2);
+		EXPECT_EQ(lru0.evictableCount(), 0);
+	}
+	EXPECT_EQ(lru0.references(1), 0);
+	EXPECT_EQ(lru1.references(5), 0);
+	EXPECT_EQ(lru0.evictableCount(), 2);
+}
+
+TEST(LruAtlas, EvictsTheLeastRecentlyUsedUnreferencedTextureWhenFull) {
+	StubTextureSource source;
+	for (unsigned long textureID = 0; textureID < 6; ++textureID) {
+		source.addTexture(textureID, 64, 64);
+	}
+	MaxRectsAtlas atlas(&source, 128, 64);
+	LruAtlas lru(&atlas);
+
+	lru.beginFrame(1);
+	lru.addTexture(0);
+	lru.addTexture(1);
+	lru.retain(0);
+	EXPECT_FALSE(lru.willFit(2));
+
+	lru.beginFrame(2);
+	EXPECT_TRUE(lru.willFit(2));
+	EXPECT_TRUE(lru.addTexture(2) != NULL);
+	EXPECT_EQ(lru.evictions(), 1);
+	EXPECT_TRUE(atlas.find(1) == NULL);
+	EXPECT_TRUE(atlas.find(0) != NULL);
+
+	lru.release(0);
+	lru.beginFrame(3);
+	lru.touch(0);
+	EXPECT_TRUE(lru.addTexture(3) != NULL);
+	EXPECT_TRUE(atlas.find(2) == NULL);
+	EXPECT_TRUE(atlas.find(0) != NULL);
+	EXPECT_EQ(lru.textureCount(), 2);
+}
+
+TEST(LruAtlas, EvictsNothingForATextureThatEvictionCannotMakeRoomFor) {
+	StubTextureSource source;
+	source.addTexture(0, 64, 64);
+	source.addTexture(1, 64, 64);
+	source.addTexture(2, 64, 64);
+	source.addTexture(3, 256, 64);
+	SkylineAtlas atlas(&source, 128, 64);
+	LruAtlas lru(&atlas);
+
+	lru.beginFrame(1);
+	lru.addTexture(0);
+	lru.addTexture(1);
+	lru.retain(0);
+
+	lru.beginFrame(2);
+	EXPECT_FALSE(lru.willFit(3));
+	EXPECT_TRUE(lru.addTexture(3) == NULL);
+	// A skyline page frees nothing while texture 0 is still on it.
+	EXPECT_FALSE(lru.willFit(2));
+	EXPECT_TRUE(lru.addTexture(2) == NULL);
+	EXPECT_EQ(lru.evictions(), 0);
+	EXPECT_EQ(lru.textureCount(), 2);
+
+	lru.release(0);
+	EXPECT_TRUE(lru.willFit(2));
+	EXPECT_EQ(lru.evictions(), 0);
+	EXPECT_TRUE(lru.addTexture(2) != NULL);
+	EXPECT_EQ(lru.evictions(), 2);
+	EXPECT_EQ(lru.textureCount(), 1);
+}
+
+TEST(LruAtlas, EvictsFromAFullTextureArray) {
+	StubTextureSource source;
+	for (unsigned long textureID = 0; textureID < 4; ++textureID) {
+		source.addTexture(textureID, 32, 32);
+	}
+	source.addTexture(9, 64, 64);
+	TextureArrayAtlas atlas(&source, 32, 32, 2);
+	LruAtlas lru(&atlas);
+
+	lru.beginFrame(1);
+	lru.addTexture(0);
+	lru.addTexture(1);
+	lru.beginFrame(2);
+	lru.touch(0);
+	EXPECT_FALSE(lru.willFit(9));
+	EXPECT_TRUE(lru.willFit(2));
+	EXPECT_EQ(lru.evictions(), 0);
+	EXPECT_TRUE(lru.addTexture(2) != NULL);
+	EXPECT_EQ(lru.evictions(), 1);
+	EXPECT_TRUE(atlas.find(1) == NULL);
+	EXPECT_TRUE(atlas.find(0) != NULL);
+	EXPECT_FALSE(lru.willFit(3));
+}
+
+TEST(LruAtlas, KeepsAtlasUseBoundedOverALongChurningSession) {
+	StubTextureSource source;
+	unsigned int seed = 99;
+	for (unsigned long textureID = 0; textureID < 400; ++textureID) {
+		seed = seed * 1103515245 + 12345;
+		source.addTexture(textureID, 8 + (seed >> 8) % 24, 8 + (seed >> 16) % 24);
+	}
+	MaxRectsAtlas atlas(&source, 256, 256);
+	LruAtlas lru(&atlas);
+
+	for (unsigned long long frame = 1; frame <= 200; ++frame) {
+		lru.beginFrame(frame);
+		for (unsigned long i = 0; i < 8; ++i) {
+			seed = seed * 1103515245 + 12345;
+			EXPECT_TRUE(lru.addTexture((seed >> 8) % 400) != NULL);
+		}
+	}
+	EXPECT_GT(lru.evictions(), 0);
+
+	std::vector<const AtlasedTexture*> placed;
+	for (unsigned long textureID = 0; textureID < 400; ++textureID) {
+		if (atlas.find(textureID)) {
+			placed.push_back(atlas.find(textureID));
+		}
+	}
+	EXPECT_EQ(placed.size(), lru.textureCount());
+	expectPackedWithoutOverlaps(placed, 256, 256);
+}
+
+TEST(PackedAtlas, EndsTheTransactionWhenTheLastOpenReservationIsRolledBack) {
+	StubTextureSource source;
+	source.addTexture(1, 32, 32);
+	source.addTexture(2, 32, 32);
+	MaxRectsAtlas atlas(&source, 128, 64);
+	atlas.enableBackingStore();
+
+	EXPECT_TRUE(atlas.reserve(1));
+	EXPECT_TRUE(atlas.reserve(2));
+	EXPECT_TRUE(atlas.commit(1) != NULL);
+	atlas.rollback(2);
+	EXPECT_TRUE(atlas.find(2) == NULL);
+
+	std::vector<AtlasPlacement> placements;
+	atlas.layout(placements);
+	std::vector<RectPacker*> pages(1, atlas.createEmptyPage());
+	pages[0]->insert(placements[0].rect.width, placements[0].rect.height, placements[0].rect);
+	std::vector<AtlasRemap> remap;
+	EXPECT_TRUE(atlas.adoptLayout(pages, placements, remap));
+	EXPECT_TRUE(atlas.removeTexture(1));
+	EXPECT_EQ(atlas.textureCount(), 0);
+}
+
+TEST(PackedAtlas, RemovedTexturesFreeTheirSpace) {
+	StubTextureSource source;
+	source.addTexture(1, 64, 64);
+	source.addTexture(2, 64, 64);
+	source.addTexture(3, 64, 64);
+	MaxRectsAtlas maxRects(&source, 128, 64);
+	SkylineAtlas skyline(&source, 128, 64);
+
+	maxRects.addTexture(1);
+	maxRects.addTexture(2);
+	EXPECT_TRUE(maxRects.removeTexture(1));
+	EXPECT_FALSE(maxRects.removeTexture(1));
+	EXPECT_TRUE(maxRects.willFit(3));
+	EXPECT_EQ(maxRects.usedArea(), 64 * 64);
+
+	skyline.addTexture(1);
+	skyline.addTexture(2);
+	EXPECT_TRUE(skyline.removeTexture(1));
+	EXPECT_FALSE(skyline.willFit(3));
+	EXPECT_TRUE(skyline.removeTexture(2));
+	EXPECT_TRUE(skyline.willFit(3));
+}
+
+bool publishRepack(AtlasRepacker& repacker) {
+	while (repacker.running()) {
+		if (repacker.poll()) {
+			return true;
+		}
+		sched_yield();
+	}
+	return false;
+}
+
+TEST(AtlasRepacker, DefragmentsAnAtlasAndPublishesWhereEachTextureMoved) {
+	StubTextureSource source;
+	for (unsigned long textureID = 0; textureID < 16; ++textureID) {
+		source.addTexture(textureID, 32, 32);
+	}
+	source.addTexture(100, 128, 64);
+	SkylineAtlas atlas(&source, 128, 128);
+	atlas.enableBackingStore();
+	for (unsigned long textureID = 0; textureID < 16; ++textureID) {
+		atlas.addTexture(textureID);
+	}
+	for (unsigned long textureID = 0; textureID < 16; textureID += 2) {
+		atlas.removeTexture(textureID);
+	}
+	EXPECT_FALSE(atlas.willFit(100));
+
+	std::vector<AtlasedTexture> before;
+	std::vector<const AtlasedTexture*> pointers;
+	for (unsigned long textureID = 1; textureID < 16; textureID += 2) {
+		before.push_back(*atlas.find(textureID));
+		pointers.push_back(atlas.find(textureID));
+	}
+
+	AtlasRepacker repacker(atlas);
+	EXPECT_TRUE(repacker.start());
+	EXPECT_FALSE(repacker.start());
+	ASSERT_TRUE(publishRepack(repacker));
+
+	EXPECT_TRUE(atlas.willFit(100));
+	EXPECT_EQ(atlas.textureCount(), 8);
+	expectPackedWithoutOverlaps(pointers, 128, 128);
+	for (size_t i = 0; i < repacker.remap().size(); ++i) {
+		const AtlasRemap& entry = repacker.remap()[i];
+		const size_t index = (entry.textureID - 1) / 2;
+		EXPECT_EQ(entry.from.x, before[index].x);
+		EXPECT_EQ(entry.from.y, before[index].y);
+		EXPECT_EQ(entry.to.x, pointers[index]->x);
+		EXPECT_EQ(entry.to.y, pointers[index]->y);
+	}
+	EXPECT_GT(repacker.remap().size(), 0);
+}
+
+TEST(AtlasRepacker, PlacesTexturesAddedWhileTheJobRan) {
+	StubTextureSource source;
+	for (unsigned long textureID = 0; textureID < 8; ++textureID) {
+		source.addTexture(textureID, 32, 32);
+	}
+	MaxRectsAtlas atlas(&source, 128, 64);
+	atlas.enableBackingStore();
+	for (unsigned long textureID = 0; textureID < 6; ++textureID) {
+		atlas.addTexture(textureID);
+	}
+
+	AtlasRepacker repacker(atlas);
+	repacker.start();
+	atlas.removeTexture(0);
+	atlas.addTexture(6);
+	atlas.addTexture(7);
+	ASSERT_TRUE(publishRepack(repacker));
+
+	std::vector<const AtlasedTexture*> placed;
+	for (unsigned long textureID = 1; textureID < 8; ++textureID) {
+		ASSERT_TRUE(atlas.find(textureID) != NULL);
+		placed.push_back(atlas.find(textureID));
+	}
+	EXPECT_TRUE(atlas.find(0) == NULL);
+	expectPackedWithoutOverlaps(placed, 128, 64);
+	EXPECT_FALSE(repacker.poll());
+}
+
+TEST(AtlasRepacker, RefillsSkylinePagesForTexturesRemovedWhileTheJobRan) {
+	StubTextureSource source;
+	for (unsigned long textureID = 0; textureID < 9; ++textureID) {
+		source.addTexture(textureID, 32, 32);
+	}
+	SkylineAtlas atlas(&source, 128, 64);
+	atlas.enableBackingStore();
+	for (unsigned long textureID = 0; textureID < 8; ++textureID) {
+		atlas.addTexture(textureID);
+	}
+
+	AtlasRepacker repacker(atlas);
+	repacker.start();
+	atlas.removeTexture(2);
+	atlas.removeTexture(5);
+	ASSERT_TRUE(publishRepack(repacker));
+
+	std::vector<const AtlasedTexture*> placed;
+	for (unsigned long textureID = 0; textureID < 8; ++textureID) {
+		if (textureID != 2 && textureID != 5) {
+			placed.push_back(atlas.find(textureID));
+		}
+	}
+	expectPackedWithoutOverlaps(placed, 128, 64);
+	EXPECT_TRUE(atlas.willFit(8));
+	EXPECT_TRUE(atlas.addTexture(8) != NULL);
+	placed.push_back(atlas.find(8));
+	expectPackedWithoutOverlaps(placed, 128, 64);
+}
+
+TEST(AtlasRepacker, RefusesAnAtlasWithoutAStoreToMoveThePixelsIn) {
+	StubTextureSource source;
+	source.addTexture(1, 32, 32);
+	MaxRectsAtlas atlas(&source, 128, 64);
+	atlas.addTexture(1);
+	const AtlasedTexture before = *atlas.find(1);
+
+	AtlasRepacker repacker(atlas);
+	EXPECT_FALSE(repacker.start());
+
+	std::vector<AtlasPlacement> placements;
+	atlas.layout(placements);
+	std::vector<RectPacker*> pages(1, atlas.createEmptyPage());
+	AtlasRect rect;
+	pages[0]->insert(64, 32, rect);
+	pages[0]->insert(32, 32, placements[0].rect);
+	std::vector<AtlasRemap> remap;
+	EXPECT_FALSE(atlas.adoptLayout(pages, placements, remap));
+	EXPECT_EQ(atlas.find(1)->x, before.x);
+	EXPECT_EQ(atlas.find(1)->y, before.y);
+	EXPECT_TRUE(remap.empty());
+}
+
+void expectImageAt(const AtlasPixels& pixels, const AtlasedTexture& texture, uint32_t base, unsigned int gutter) {
+	for (unsigned int y = 0; y < texture.height + 2 * gutter; ++y) {
+		for (unsigned int x = 0; x < texture.width + 2 * gutter; ++x) {
+			unsigned int imageX = x < gutter ? 0 : (x - gutter >= texture.width ? texture.width - 1 : x - gutter);
+			unsigned int imageY = y < gutter ? 0 : (y - gutter >= texture.height ? texture.height - 1 : y - gutter);
+			ASSERT_EQ(pixels.pixel(texture.layer, texture.x - gutter + x, texture.y - gutter + y), base + imageY * texture.width + imageX);
+		}
+	}
+}
+
+TEST(AtlasPixels, CopiesRowsOfAnyLength) {
+	uint32_t source[23];
+	for (unsigned int i = 0; i < 23; ++i) {
+		source[i] = 1000 + i;
+	}
+	for (size_t count = 0; count <= 21; ++count) {
+		uint32_t destination[23] = { 0 };
+		AtlasPixels::copyRow(destination + 1, source + 2, count);
+		EXPECT_EQ(destination[0], 0);
+		for (size_t i = 0; i < count; ++i) {
+			EXPECT_EQ(destination[1 + i], source[2 + i]);
+		}
+		EXPECT_EQ(destination[1 + count], 0);
+	}
+}
+
+TEST(PackedAtlas, BlitsImagesIntoTheBackingStoreWithExtrudedGutters) {
+	StubImageSource source;
+	source.addImage(1, 13, 7, 100);
+	source.addImage(2, 5, 9, 5000);
+	source.addTexture(3, 8, 8);
+	SkylineAtlas atlas(&source, 64, 32);
+	EXPECT_TRUE(atlas.setGutter(2));
+	EXPECT_TRUE(atlas.enableBackingStore());
+
+	const AtlasedTexture* first = atlas.addTexture(1);
+	const AtlasedTexture* second = atlas.addTexture(2);
+	ASSERT_TRUE(first != NULL && second != NULL);
+	EXPECT_TRUE(atlas.addTexture(3) != NULL);
+	EXPECT_FALSE(atlas.setGutter(1));
+
+	EXPECT_EQ(first->x, 2);
+	EXPECT_EQ(first->y, 2);
+	EXPECT_EQ(first->width, 13);
+	EXPECT_EQ(second->x, 19);
+	EXPECT_FLOAT_EQ(first->u0, 2.0f / 64.0f);
+	ASSERT_TRUE(atlas.backingStore() != NULL);
+	expectImageAt(*atlas.backingStore(), *first, 100, 2);
+	expectImageAt(*atlas.backingStore(), *second, 5000, 2);
+}
+
+TEST(AtlasRepacker, MovesBackingStorePixelsWithTheirTextures) {
+	StubImageSource source;
+	for (unsigned long textureID = 0; textureID < 12; ++textureID) {
+		source.addImage(textureID, 10 + textureID % 3, 12 - textureID % 4, 1000 * (uint32_t)textureID);
+	}
+	MaxRectsAtlas atlas(&source, 64, 64);
+	atlas.setGutter(1);
+	atlas.enableBackingStore();
+	for (unsigned long textureID = 0; textureID < 12; ++textureID) {
+		atlas.addTexture(textureID);
+	}
+	for (unsigned long textureID = 0; textureID < 12; textureID += 3) {
+		atlas.removeTexture(textureID);
+	}
+
+	AtlasRepacker repacker(atlas);
+	repacker.start();
+	ASSERT_TRUE(publishRepack(repacker));
+	EXPECT_GT(repacker.remap().size(), 0);
+	for (unsigned long textureID = 0; textureID < 12; ++textureID) {
+		if (textureID % 3) {
+			expectImageAt(*atlas.backingStore(), *atlas.find(textureID), 1000 * (uint32_t)textureID, 1);
+		}
+	}
+}
+
+class CountingUploader : public AtlasUploader {
+public:
+	inline CountingUploader() : m_calls(0), m_bytes(0), m_missingPixels(0) {};
+
+	void upload (const unsigned int, const AtlasRect& rect, const uint32_t* pixels, const size_t) {
+		++m_calls;
+		m_bytes += (unsigned long long)rect.width * rect.height * 4;
+		if (!pixels) {
+			++m_missingPixels;
+		}
+	}
+
+	size_t m_calls;
+	unsigned long long m_bytes;
+	size_t m_missingPixels;
+};
+
+TEST(DirtyRects, MergesNearbyRectsOnAPageButKeepsPagesAndDistantRectsApart) {
+	DirtyRects dirty(64);
+	AtlasRect left = { 0, 0, 16, 16 };
+	AtlasRect right = { 16, 0, 16, 16 };
+	AtlasRect below = { 0, 16, 32, 16 };
+	AtlasRect far = { 200, 200, 8, 8 };
+	dirty.add(0, left);
+	dirty.add(0, right);
+	dirty.add(0, below);
+	dirty.add(0, far);
+	dirty.add(1, left);
+
+	std::vector<AtlasDirtyRect> rects;
+	dirty.take(rects);
+	ASSERT_EQ(rects.size(), 3);
+	EXPECT_EQ(rects[0].page, 0);
+	EXPECT_EQ(rects[0].rect.width, 32);
+	EXPECT_EQ(rects[0].rect.height, 32);
+	EXPECT_TRUE(dirty.empty());
+}
+
+TEST(DirtyRects, MergesAFrameOfManySpritesIntoAFewRectsCoveringThemAll) {
+	DirtyRects dirty;
+	std::vector<AtlasRect> written;
+	for (unsigned int y = 0; y < 2048; y += 16) {
+		for (unsigned int x = 0; x < 2048; x += 16) {
+			const AtlasRect rect = { x, y, 16, 16 };
+			written.push_back(rect);
+		}
+	}
+	std::random_shuffle(written.begin(), written.end());
+	for (size_t i = 0; i < written.size(); ++i) {
+		dirty.add(0, written[i]);
+	}
+
+	std::vector<AtlasDirtyRect> rects;
+	dirty.take(rects);
+	EXPECT_LE(rects.size(), 4);
+	for (size_t i = 0; i < written.size(); i += 97) {
+		bool covered = false;
+		for (size_t j = 0; j < rects.size() && !covered; ++j) {
+			const AtlasRect& box = rects[j].rect;
+			covered = written[i].x >= box.x && written[i].y >= box.y &&
+				written[i].x + written[i].width <= box.x + box.width && written[i].y + written[i].height <= box.y + box.height;
+		}
+		EXPECT_TRUE(covered);
+	}
+}
+
+TEST(PackedAtlas, UploadsAFrameOfSmallSpritesInAFewCoalescedCalls) {
+	StubImageSource source;
+	for (unsigned long textureID = 0; textureID < 256; ++textureID) {
+		source.addImage(textureID, 16, 16, 0);
+	}
+	SkylineAtlas atlas(&source, 256, 256);
+	atlas.enableBackingStore();
+
+	CountingUploader uploader;
+	EXPECT_EQ(atlas.upload(uploader), 0);
+	for (unsigned long textureID = 0; textureID < 64; ++textureID) {
+		atlas.addTexture(textureID);
+	}
+	atlas.upload(uploader);
+	EXPECT_LE(uploader.m_calls, 4);
+	EXPECT_GE(uploader.m_bytes, 64 * 16 * 16 * 4);
+	EXPECT_LE(uploader.m_bytes, 2 * 64 * 16 * 16 * 4);
+	EXPECT_EQ(uploader.m_missingPixels, 0);
+
+	const size_t calls = uploader.m_calls;
+	EXPECT_EQ(atlas.upload(uploader), 0);
+	EXPECT_EQ(uploader.m_calls, calls);
+}
+
+TEST(PackedAtlas, MergesUploadsByTheCallCostItWasGiven) {
+	StubImageSource source;
+	for (unsigned long textureID = 0; textureID < 64; ++textureID) {
+		source.addImage(textureID, 16, 16, 0);
+	}
+	SkylineAtlas atlas(&source, 256, 256);
+	atlas.enableBackingStore();
+	EXPECT_EQ(atlas.uploadCallCost(), DirtyRects::kDefaultCallCost);
+
+	CountingUploader uploader;
+	ASSERT_TRUE(atlas.setGutter(1));
+	atlas.setUploadCallCost(0);
+	for (unsigned long textureID = 0; textureID < 64; ++textureID) {
+		atlas.addTexture(textureID);
+	}
+	atlas.upload(uploader);
+	const size_t separateCalls = uploader.m_calls;
+
+	SkylineAtlas merging(&source, 256, 256);
+	merging.enableBackingStore();
+	merging.setUploadCallCost(1 << 20);
+	for (unsigned long textureID = 0; textureID < 64; ++textureID) {
+		merging.addTexture(textureID);
+	}
+	uploader.m_calls = 0;
+	merging.upload(uploader);
+	EXPECT_EQ(uploader.m_calls, 1);
+	EXPECT_GT(separateCalls, 1);
+}
+
+void expectBlocksAt(const AtlasBlocks& blocks, const AtlasedTexture& texture, unsigned long textureID) {
+	const unsigned int blocksWide = (texture.width + 3) / 4;
+	for (unsigned int y = 0; y < texture.height; y += 4) {
+		for (unsigned int x = 0; x < texture.width; x += 4) {
+			const uint8_t* block = blocks.block(texture.layer, texture.x + x, texture.y + y);
+			ASSERT_EQ(block[0], (uint8_t)textureID);
+			ASSERT_EQ(block[1], (uint8_t)((y / 4) * blocksWide + x / 4));
+		}
+	}
+}
+
+TEST(PackedAtlas, BlockAlignedModePlacesEveryRectOnABlockBoundary) {
+	StubTextureSource source;
+	unsigned int seed = 7;
+	for (unsigned long textureID = 0; textureID < 200; ++textureID) {
+		seed = seed * 1103515245 + 12345;
+		source.addTexture(textureID, 1 + (seed >> 8) % 30, 1 + (seed >> 16) % 30);
+	}
+	SkylineAtlas skyline(&source, 256, 256);
+	MaxRectsAtlas maxRects(&source, 256, 256);
+	EXPECT_FALSE(skyline.setBlockSize(3));
+	EXPECT_TRUE(skyline.setGutter(4));
+	EXPECT_TRUE(skyline.setBlockSize(4));
+	EXPECT_FALSE(skyline.setGutter(2));
+	EXPECT_TRUE(maxRects.setBlockSize(4));
+
+	for (unsigned long textureID = 0; textureID < 200; ++textureID) {
+		const AtlasedTexture* packed[2] = { skyline.addTexture(textureID), maxRects.addTexture(textureID) };
+		for (int i = 0; i < 2; ++i) {
+			if (packed[i]) {
+				EXPECT_EQ(packed[i]->x % 4, 0);
+				EXPECT_EQ(packed[i]->y % 4, 0);
+			}
+		}
+	}
+	EXPECT_GT(maxRects.textureCount(), 0);
+	EXPECT_EQ(maxRects.usedArea() % 16, 0);
+}
+
+TEST(PackedAtlas, CopiesWholeBlocksIntoTheBlockStoreAndAcrossRepacks) {
+	StubBlockSource source;
+	for (unsigned long textureID = 0; textureID < 10; ++textureID) {
+		source.addBlockImage(textureID, 6 + textureID, 13 - textureID);
+	}
+	MaxRectsAtlas atlas(&source, 64, 64);
+	EXPECT_FALSE(atlas.enableBlockStore(8));
+	EXPECT_TRUE(atlas.setBlockSize(4));
+	EXPECT_TRUE(atlas.setGutter(4));
+	EXPECT_TRUE(atlas.enableBlockStore(8));
+	EXPECT_FALSE(atlas.enableBackingStore());
+
+	for (unsigned long textureID = 0; textureID < 10; ++textureID) {
+		atlas.addTexture(textureID);
+	}
+	for (unsigned long textureID = 0; textureID < 10; textureID += 2) {
+		atlas.removeTexture(textureID);
+	}
+	const AtlasedTexture* texture = atlas.find(1);
+	ASSERT_TRUE(texture != NULL);
+	expectBlocksAt(*atlas.blockStore(), *texture, 1);
+	EXPECT_EQ(atlas.blockStore()->block(texture->layer, texture->x - 4, texture->y - 4)[1], 0);
+
+	AtlasRepacker repacker(atlas);
+	repacker.start();
+	ASSERT_TRUE(publishRepack(repacker));
+	for (unsigned long textureID = 1; textureID < 10; textureID += 2) {
+		expectBlocksAt(*atlas.blockStore(), *atlas.find(textureID), textureID);
+	}
+}
+
+TEST(PackedAtlas, DuplicateImagesShareOneRegion) {
+	StubImageSource source;
+	source.addImage(1, 64, 64, 7);
+	source.addImage(2, 64, 64, 7);
+	source.addImage(3, 64, 64, 9);
+	source.addImage(4, 32, 128, 7);
+	SkylineAtlas atlas(&source, 64, 64);
+	EXPECT_TRUE(atlas.enableDeduplication());
+
+	const AtlasedTexture* first = atlas.addTexture(1);
+	ASSERT_TRUE(first != NULL);
+	EXPECT_TRUE(atlas.willFit(2));
+	EXPECT_FALSE(atlas.willFit(3));
+	EXPECT_FALSE(atlas.willFit(4));
+
+	const AtlasedTexture* second = atlas.addTexture(2);
+	ASSERT_TRUE(second != NULL);
+	EXPECT_EQ(second->x, first->x);
+	EXPECT_EQ(second->y, first->y);
+	EXPECT_EQ(atlas.textureCount(), 2);
+	EXPECT_EQ(atlas.duplicateCount(), 1);
+	EXPECT_EQ(atlas.usedArea(), 64 * 64);
+}
+
+// Files a texture's image under another texture's content hash, as a hash collision would.
+class CollidingAtlas : public MaxRectsAtlas {
+public:
+	inline CollidingAtlas(TextureSource* source, const unsigned int width, const unsigned int height) : MaxRectsAtlas(source, width, height) {};
+
+	void collide (const unsigned long textureID, const unsigned long owner) {
+		unsigned int width, height;
+		uint64_t hash;
+		m_source->getSize(textureID, width, height);
+		hashContent(textureID, width, height, hash);
+		m_contentOwners[hash] = owner;
+	}
+};
+
+TEST(PackedAtlas, GivesCollidingImagesTheirOwnRegions) {
+	StubImageSource source;
+	source.addImage(1, 32, 32, 7);
+	source.addImage(2, 32, 32, 9);
+	CollidingAtlas atlas(&source, 64, 32);
+	atlas.enableDeduplication();
+	atlas.addTexture(1);
+	atlas.collide(2, 1);
+
+	const AtlasedTexture* second = atlas.addTexture(2);
+	ASSERT_TRUE(second != NULL);
+	EXPECT_NE(second->x, atlas.find(1)->x);
+	EXPECT_EQ(atlas.duplicateCount(), 0);
+	EXPECT_EQ(atlas.usedArea(), 2 * 32 * 32);
+}
+
+TEST(PackedAtlas, KeepsASharedRegionUntilTheLastTextureUsingItIsRemoved) {
+	StubImageSource source;
+	source.addImage(1, 64, 64, 7);
+	source.addImage(2, 64, 64, 7);
+	source.addImage(3, 64, 64, 7);
+	source.addImage(4, 64, 64, 8);
+	MaxRectsAtlas atlas(&source, 64, 64);
+	atlas.enableDeduplication();
+	atlas.addTexture(1);
+	atlas.addTexture(2);
+	atlas.addTexture(3);
+
+	EXPECT_TRUE(atlas.removeTexture(1));
+	EXPECT_TRUE(atlas.find(1) == NULL);
+	EXPECT_FALSE(atlas.willFit(4));
+	EXPECT_TRUE(atlas.willFit(1));
+	EXPECT_TRUE(atlas.removeTexture(2));
+	EXPECT_FALSE(atlas.willFit(4));
+	EXPECT_TRUE(atlas.removeTexture(3));
+	EXPECT_EQ(atlas.textureCount(), 0);
+	EXPECT_TRUE(atlas.willFit(4));
+}
+
+TEST(PackedAtlas, TrimsTransparentBordersAndKeepsTheOffsets) {
+	StubImageSource source;
+	source.addSprite(1, 64, 64, 10, 20, 30, 16, 0);
+	source.addSprite(2, 32, 32, 0, 0, 0, 0, 0);
+	MaxRectsAtlas atlas(&source, 128, 128);
+	EXPECT_TRUE(atlas.enableBackingStore());
+	EXPECT_TRUE(atlas.enableTrimming());
+
+	const AtlasedTexture* sprite = atlas.addTexture(1);
+	ASSERT_TRUE(sprite != NULL);
+	EXPECT_EQ(sprite->width, 30);
+	EXPECT_EQ(sprite->height, 16);
+	EXPECT_EQ(sprite->trimX, 10);
+	EXPECT_EQ(sprite->trimY, 20);
+	EXPECT_EQ(sprite->sourceWidth, 64);
+	EXPECT_EQ(sprite->sourceHeight, 64);
+	EXPECT_EQ(atlas.usedArea(), 30 * 16);
+	EXPECT_FALSE(atlas.enableTrimming());
+	for (unsigned int y = 0; y < sprite->height; ++y) {
+		for (unsigned int x = 0; x < sprite->width; ++x) {
+			ASSERT_EQ(atlas.backingStore()->pixel(sprite->layer, sprite->x + x, sprite->y + y), 0xff000000u + (20 + y) * 64 + 10 + x);
+		}
+	}
+
+	const AtlasedTexture* empty = atlas.addTexture(2);
+	ASSERT_TRUE(empty != NULL);
+	EXPECT_EQ(empty->width, 1);
+	EXPECT_EQ(empty->height, 1);
+	EXPECT_EQ(empty->trimX, 0);
+	EXPECT_EQ(empty->sourceWidth, 32);
+}
+
+TEST(PackedAtlas, PacksMoreSpritesPerPageWhenTrimming) {
+	StubImageSource source;
+	for (unsigned long textureID = 0; textureID < 16; ++textureID) {
+		source.addSprite(textureID, 64, 64, 16, 16, 32, 32, 0);
+	}
+	SkylineAtlas whole(&source, 128, 128);
+	SkylineAtlas trimmed(&source, 128, 128);
+	EXPECT_TRUE(trimmed.enableTrimming());
+
+	size_t wholeCount = 0, trimmedCount = 0;
+	for (unsigned long textureID = 0; textureID < 16; ++textureID) {
+		wholeCount += whole.addTexture(textureID) != NULL;
+		trimmedCount += trimmed.addTexture(textureID) != NULL;
+	}
+	EXPECT_EQ(wholeCount, 4);
+	EXPECT_EQ(trimmedCount, 16);
+}
+
+TEST(AtlasRepacker, MovesDuplicatesWithTheRegionTheyShare) {
+	StubImageSource source;
+	for (unsigned long textureID = 0; textureID < 8; ++textureID) {
+		source.addImage(textureID, 32, 32, 100 * (uint32_t)textureID);
+	}
+	source.addImage(100, 32, 32, 700);
+	MaxRectsAtlas atlas(&source, 128, 64);
+	atlas.enableDeduplication();
+	atlas.enableBackingStore();
+	for (unsigned long textureID = 0; textureID < 8; ++textureID) {
+		atlas.addTexture(textureID);
+	}
+	atlas.addTexture(100);
+	for (unsigned long textureID = 0; textureID < 8; textureID += 2) {
+		atlas.removeTexture(textureID);
+	}
+
+	AtlasRepacker repacker(atlas);
+	repacker.start();
+	ASSERT_TRUE(publishRepack(repacker));
+	EXPECT_EQ(atlas.find(100)->x, atlas.find(7)->x);
+	EXPECT_EQ(atlas.find(100)->y, atlas.find(7)->y);
+	EXPECT_EQ(atlas.usedArea(), 4 * 32 * 32);
+}
+
+// A path for a scratch file that is removed when the test ends.
+class ScratchFile {
+public:
+	inline ScratchFile() {
+		char path[] = "/tmp/atlas_test_XXXXXX";
+		const int descriptor = mkstemp(path);
+		if (descriptor >= 0) {
+			close(descriptor);
+		}
+		m_path = path;
+	};
+	inline ~ScratchFile() { unlink(m_path.c_str()); };
+	inline const char* path() const { return m_path.c_str(); };
+
+private:
+	std::string m_path;
+};
+
+TEST(BakedAtlas, ServesTheBakedPlacementsAndPagesWithoutPacking) {
+	StubImageSource source;
+	std::vector<unsigned long> textureIDs;
+	for (unsigned long textureID = 0; textureID < 6; ++textureID) {
+		source.addImage(textureID * 10, 40, 30, 1000 * (uint32_t)textureID);
+		textureIDs.push_back(textureID * 10);
+	}
+	MaxRectsAtlas atlas(&source, 64, 64, 8);
+	atlas.setGutter(1);
+	atlas.enableBackingStore();
+	for (size_t i = 0; i < textureIDs.size(); ++i) {
+		ASSERT_TRUE(atlas.addTexture(textureIDs[i]) != NULL);
+	}
+
+	ScratchFile scratch;
+	ASSERT_TRUE(writeAtlasFile(scratch.path(), atlas, textureIDs));
+	AtlasFile file;
+	ASSERT_TRUE(file.open(scratch.path()));
+	EXPECT_EQ(file.header().pageCount, atlas.pageCount());
+
+	BakedAtlas baked(file);
+	EXPECT_EQ(baked.textureCount(), 6);
+	for (size_t i = 0; i < textureIDs.size(); ++i) {
+		const AtlasedTexture* packed = atlas.find(textureIDs[i]);
+		const AtlasedTexture* loaded = baked.addTexture(textureIDs[i]);
+		ASSERT_TRUE(loaded != NULL);
+		EXPECT_EQ(loaded->x, packed->x);
+		EXPECT_EQ(loaded->y, packed->y);
+		EXPECT_EQ(loaded->layer, packed->layer);
+		EXPECT_EQ(loaded->sourceWidth, 40);
+		EXPECT_FLOAT_EQ(loaded->u1, packed->u1);
+		EXPECT_EQ(file.page(loaded->layer)[loaded->y * 64 + loaded->x], 1000 * (uint32_t)i);
+	}
+	EXPECT_FALSE(baked.willFit(5));
+	EXPECT_TRUE(baked.find(60) == NULL);
+
+	CountingUploader uploader;
+	EXPECT_EQ(baked.upload(uploader), atlas.pageCount());
+	EXPECT_EQ(uploader.m_bytes, atlas.pageCount() * 64 * 64 * 4);
+	EXPECT_EQ(uploader.m_missingPixels, 0);
+}
+
+// Gives the first catalogue the baked atlas and every later one the dynamic atlas.
+class BakedThenDynamicRegistry : public BatchCatalogueRegistry {
+public:
+	inline BakedThenDynamicRegistry(TextureManager::Atlas* baked, TextureManager::Atlas* dynamic) : m_baked(baked), m_dynamic(dynamic) {};
+
+protected:
+	TextureManager::Atlas* m_baked;
+	TextureManager::Atlas* m_dynamic;
+
+	BatchCatalogue* createCatalogue (const BatchDescriptor& descriptor) {
+		TextureManager::Atlas* atlas = size() == 0 ? m_baked : m_dynamic;
+		return new BatchCatalogueWithAtlas(descriptor.format, descriptor.isStatic, descriptor.vShader, descriptor.fShader, descriptor.indicies, atlas, NULL, NULL, NULL);
+	}
+};
+
+TEST(BakedAtlas, RejectsUnbakedTexturesSoTheRegistryOpensACatalogueOnAnotherAtlas) {
+	StubImageSource source;
+	source.addImage(1, 16, 16, 0);
+	source.addImage(2, 16, 16, 0);
+	SkylineAtlas atlas(&source, 32, 32);
+	atlas.enableBackingStore();
+	ASSERT_TRUE(atlas.addTexture(1) != NULL);
+
+	ScratchFile scratch;
+	ASSERT_TRUE(writeAtlasFile(scratch.path(), atlas, std::vector<unsigned long>(1, 1)));
+	AtlasFile file;
+	ASSERT_TRUE(file.open(scratch.path()));
+	BakedAtlas baked(file);
+	EXPECT_FALSE(baked.willFit(2));
+	EXPECT_TRUE(baked.addTexture(2) == NULL);
+
+	SkylineAtlas dynamic(&source, 32, 32);
+	BakedThenDynamicRegistry registry(&baked, &dynamic);
+	BatchDescriptor bakedTexture = { BufferedBatch::kFormatUsesTextureUnit0, false, NULL, NULL, false, { 1, 0, 0, 0 } };
+	BatchDescriptor unbakedTexture = { BufferedBatch::kFormatUsesTextureUnit0, false, NULL, NULL, false, { 2, 0, 0, 0 } };
+
+	BatchCatalogue* first = registry.catalogueFor(bakedTexture);
+	BatchCatalogue* second = registry.catalogueFor(unbakedTexture);
+	ASSERT_TRUE(first != NULL);
+	ASSERT_TRUE(second != NULL);
+	EXPECT_NE(first, second);
+	EXPECT_EQ(registry.size(), 2);
+	EXPECT_TRUE(dynamic.find(2) != NULL);
+	EXPECT_TRUE(dynamic.find(1) == NULL);
+
+	file.close();
+	EXPECT_FALSE(baked.willFit(1));
+	EXPECT_EQ(baked.pageCount(), 0);
+}
+
+TEST(AtlasFile, RejectsFilesOfAnotherVersionOrCutShort) {
+	StubImageSource source;
+	source.addImage(1, 16, 16, 0);
+	SkylineAtlas atlas(&source, 32, 32);
+	atlas.enableBackingStore();
+	atlas.addTexture(1);
+	std::vector<unsigned long> textureIDs(1, 1);
+
+	ScratchFile scratch;
+	AtlasFile file;
+	EXPECT_FALSE(file.open(scratch.path()));
+	EXPECT_FALSE(writeAtlasFile(scratch.path(), atlas, std::vector<unsigned long>(1, 2)));
+	ASSERT_TRUE(writeAtlasFile(scratch.path(), atlas, textureIDs));
+	ASSERT_TRUE(file.open(scratch.path()));
+	file.close();
+
+	ASSERT_EQ(truncate(scratch.path(), sizeof(AtlasFileHeader) + sizeof(AtlasFileEntry) + 100), 0);
+	EXPECT_FALSE(file.open(scratch.path()));
+
+	ASSERT_TRUE(writeAtlasFile(scratch.path(), atlas, textureIDs));
+	FILE* stream = fopen(scratch.path(), "r+b");
+	ASSERT_TRUE(stream != NULL);
+	const uint32_t version = kAtlasFileVersion + 1;
+	fseek(stream, offsetof(AtlasFileHeader, version), SEEK_SET);
+	fwrite(&version, sizeof(version), 1, stream);
+	fclose(stream);
+	EXPECT_FALSE(file.open(scratch.path()));
+	EXPECT_FALSE(file.isOpen());
+}
+
+void patchAtlasFile(const char* path, const long offset, const uint32_t value) {
+	FILE* stream = fopen(path, "r+b");
+	ASSERT_TRUE(stream != NULL);
+	fseek(stream, offset, SEEK_SET);
+	fwrite(&value, sizeof(value), 1, stream);
+	fclose(stream);
+}
+
+TEST(AtlasFile, RejectsHeadersThatOverflowAndEntriesOffTheirPageOrOutOfOrder) {
+	StubImageSource source;
+	source.addImage(1, 16, 16, 0);
+	source.addImage(2, 16, 16, 0);
+	SkylineAtlas atlas(&source, 32, 32);
+	atlas.enableBackingStore();
+	atlas.addTexture(1);
+	atlas.addTexture(2);
+	std::vector<unsigned long> textureIDs;
+	textureIDs.push_back(1);
+	textureIDs.push_back(2);
+
+	ScratchFile scratch;
+	AtlasFile file;
+	const long entry = sizeof(AtlasFileHeader);
+	const long second = entry + sizeof(AtlasFileEntry);
+
+	// 4 pages of 2^31 x 2^31 pixels wrap the byte count to zero.
+	ASSERT_TRUE(writeAtlasFile(scratch.path(), atlas, textureIDs));
+	patchAtlasFile(scratch.path(), offsetof(AtlasFileHeader, pageWidth), 1u << 31);
+	patchAtlasFile(scratch.path(), offsetof(AtlasFileHeader, pageHeight), 1u << 31);
+	patchAtlasFile(scratch.path(), offsetof(AtlasFileHeader, pageCount), 4);
+	EXPECT_FALSE(file.open(scratch.path()));
+
+	ASSERT_TRUE(writeAtlasFile(scratch.path(), atlas, textureIDs));
+	patchAtlasFile(scratch.path(), entry + offsetof(AtlasFileEntry, layer), 1);
+	EXPECT_FALSE(file.open(scratch.path()));
+
+	ASSERT_TRUE(writeAtlasFile(scratch.path(), atlas, textureIDs));
+	patchAtlasFile(scratch.path(), entry + offsetof(AtlasFileEntry, x), 20);
+	EXPECT_FALSE(file.open(scratch.path()));
+
+	ASSERT_TRUE(writeAtlasFile(scratch.path(), atlas, textureIDs));
+	patchAtlasFile(scratch.path(), second + offsetof(AtlasFileEntry, textureID), 0);
+	EXPECT_FALSE(file.open(scratch.path()));
+
+	BakedAtlas baked(file);
+	EXPECT_EQ(baked.textureCount(), 0);
+	EXPECT_EQ(baked.pageCount(), 0);
+	EXPECT_FALSE(baked.willFit(1));
+	CountingUploader uploader;
+	EXPECT_EQ(baked.upload(uploader), 0);
+
+	ASSERT_TRUE(writeAtlasFile(scratch.path(), atlas, textureIDs));
+	EXPECT_TRUE(file.open(scratch.path()));
+}
+
+TEST(CooccurrenceRecorder, RecordsWhatTheRegistryPlacesAndNothingItTurnsDown) {
+	MockAtlas atlas;
+	EXPECT_CALL(atlas, willFit(1)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas, willFit(2)).WillRepeatedly(Return(true));
+	EXPECT_CALL(atlas, willFit(7)).WillRepeatedly(Return(false));
+	EXPECT_CALL(atlas, addTexture(_)).WillRepeatedly(Return(&kPlacedTexture));
+
+	CooccurrenceRecorder recorder;
+	BatchCatalogueRegistryWithAtlas registry(&atlas);
+	unsigned long dataFormat = BufferedBatch::kFormatUsesTextureUnit0;
+	BatchDescriptor first = { dataFormat, false, NULL, NULL, false, { 1, 0, 0, 0 } };
+	BatchDescriptor second = { dataFormat, false, NULL, NULL, false, { 2, 0, 0, 0 } };
+	BatchDescriptor oversized = { dataFormat, false, NULL, NULL, false, { 7, 0, 0, 0 } };
+	BatchDescriptor staticFirst = { dataFormat, true, NULL, NULL, false, { 1, 0, 0, 0 } };
+
+	ASSERT_TRUE(registry.catalogueFor(first) != NULL);
+	registry.setRecorder(&recorder);
+	EXPECT_TRUE(registry.catalogueFor(first) != NULL);
+	EXPECT_TRUE(registry.catalogueFor(second) != NULL);
+	EXPECT_TRUE(registry.catalogueFor(oversized) == NULL);
+	EXPECT_TRUE(registry.catalogueFor(staticFirst) != NULL);
+	EXPECT_EQ(registry.size(), 2);
+	recorder.endFrame();
+
+	EXPECT_EQ(recorder.pairCount(1, 2), 1);
+	EXPECT_EQ(recorder.textures().size(), 2);
+	EXPECT_EQ(recorder.textures().find(1)->second, 2);
+	EXPECT_EQ(recorder.textures().count(7), 0);
+}
+
+TEST(CooccurrenceRecorder, CountsTexturesDrawnTogetherByOneBatchKeyPerFrame) {
+	CooccurrenceRecorder recorder;
+	BatchCatalogueWithStubTexture sprites(0, false, NULL, NULL, false);
+	BatchCatalogueWithStubTexture overlays(1, false, NULL, NULL, false);
+	sprites.setRecorder(&recorder);
+	overlays.setRecorder(&recorder);
+
+	for (int frame = 0; frame < 3; ++frame) {
+		for (unsigned int textureID = 1; textureID <= 3; ++textureID) {
+			BatchDescriptor sprite = { 0, false, NULL, NULL, false, { textureID, 0, 0, 0 } };
+			EXPECT_TRUE(sprites.isMatch(sprite, false));
+			EXPECT_TRUE(sprites.isMatch(sprite, false));
+		}
+		BatchDescriptor overlay = { 1, false, NULL, NULL, false, { frame < 2 ? 9u : 1u, 0, 0, 0 } };
+		EXPECT_TRUE(overlays.isMatch(overlay, false));
+		BatchDescriptor checked = { 1, false, NULL, NULL, false, { 7, 0, 0, 0 } };
+		EXPECT_TRUE(overlays.isMatch(checked, true));
+		recorder.endFrame();
+	}
+
+	EXPECT_EQ(recorder.frames(), 3);
+	EXPECT_EQ(recorder.pairCount(1, 2), 3);
+	EXPECT_EQ(recorder.pairCount(3, 1), 3);
+	EXPECT_EQ(recorder.pairCount(1, 9), 0);
+	EXPECT_EQ(recorder.pairs().size(), 3);
+	EXPECT_EQ(recorder.textures().find(1)->second, 4);
+	EXPECT_EQ(recorder.textures().find(9)->second, 2);
+	EXPECT_EQ(recorder.textures().count(7), 0);
+
+	ScratchFile scratch;
+	ASSERT_TRUE(recorder.save(scratch.path()));
+	CooccurrenceRecorder loaded;
+	ASSERT_TRUE(loaded.load(scratch.path()));
+	ASSERT_TRUE(loaded.load(scratch.path()));
+	EXPECT_EQ(loaded.frames(), 6);
+	EXPECT_EQ(loaded.pairCount(2, 3), 6);
+}
+
+TEST(PageGrouping, KeepsTexturesDrawnTogetherOnOnePage) {
+	// Two sets of four 32x32 sprites, each drawn as a set; sorted by size, first fit would
+	// mix them across two 64x64 pages.
+	std::vector<GroupedTexture> textures;
+	CooccurrenceRecorder recorder;
+	for (unsigned long textureID = 0; textureID < 8; ++textureID) {
+		GroupedTexture texture = { textureID, 32 - (unsigned int)textureID, 32 };
+		textures.push_back(texture);
+		recorder.record(textureID % 2, textureID);
+	}
+	recorder.endFrame();
+
+	MaxRectsPacker prototype(64, 64);
+	PageGrouping grouping(prototype, 2);
+	std::map<unsigned long, unsigned int> firstFit, grouped;
+	ASSERT_TRUE(grouping.assignFirstFit(textures, firstFit));
+	ASSERT_TRUE(grouping.assign(textures, recorder, grouped));
+	EXPECT_EQ(grouped.size(), 8);
+	EXPECT_GT(PageGrouping::splitWeight(recorder, firstFit), 0);
+	EXPECT_EQ(PageGrouping::splitWeight(recorder, grouped), 0);
+	EXPECT_NE(grouped[0], grouped[1]);
+
+	PageGrouping tooSmall(prototype, 1);
+	EXPECT_FALSE(tooSmall.assign(textures, recorder, grouped));
+}
+
+TEST(PackedAtlas, PlacesHintedTexturesOnTheirPageWhileItHasRoom) {
+	StubTextureSource source;
+	source.addTexture(1, 32, 32);
+	source.addTexture(2, 32, 32);
+	source.addTexture(3, 64, 64);
+	source.addTexture(4, 32, 32);
+	MaxRectsAtlas atlas(&source, 64, 64, 3);
+	atlas.setPageHint(1, 2);
+	atlas.setPageHint(3, 2);
+	atlas.setPageHint(4, 5);
+
+	EXPECT_EQ(atlas.addTexture(1)->layer, 2);
+	EXPECT_EQ(atlas.pageCount(), 3);
+	EXPECT_EQ(atlas.addTexture(2)->layer, 0);
+	EXPECT_EQ(atlas.addTexture(3)->layer, 1);
+	EXPECT_EQ(atlas.addTexture(4)->layer, 0);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleMock(&argc, argv);
 
@@ -0,0 +1,81 @@
+#ifndef DIRECTORY_IMAGE_SOURCE_CPP
+#define DIRECTORY_IMAGE_SOURCE_CPP
+
+#include <stdio.h>
+#include <dirent.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "../src/min_deps.cpp"
+
+// TextureSource over a directory of raw images, for the offline tools. Each image is a file
+// named <id>_<width>x<height>.rgba holding width * height RGBA8 pixels, rows top to bottom;
+// other files are skipped.
+class DirectoryImageSource : public TextureSource {
+public:
+	struct Image {
+		unsigned int width;
+		unsigned int height;
+		std::vector<uint32_t> pixels;
+	};
+
+	std::map<unsigned long, Image> images;
+
+	bool getSize (const unsigned long textureID, unsigned int& width, unsigned int& height) {
+		std::map<unsigned long, Image>::const_iterator found = images.find(textureID);
+		if (found == images.end()) {
+			return false;
+		}
+		width = found->second.width;
+		height = found->second.height;
+		return true;
+	}
+
+	const uint32_t* getPixels (const unsigned long textureID) {
+		std::map<unsigned long, Image>::const_iterator found = images.find(textureID);
+		return found == images.end() || found->second.pixels.empty() ? NULL : &found->second.pixels[0];
+	}
+
+	bool load (const std::string& directory) {
+		DIR* listing = opendir(directory.c_str());
+		if (!listing) {
+			fprintf(stderr, "cannot open %s\n", directory.c_str());
+			return false;
+		}
+
+		bool loaded = true;
+		for (dirent* file = readdir(listing); file && loaded; file = readdir(listing)) {
+			unsigned long textureID;
+			unsigned int width, height;
+			int length = 0;
+			if (sscanf(file->d_name, "%lu_%ux%u.rgba%n", &textureID, &width, &height, &length) != 3 || file->d_name[length] != '\0' || !length) {
+				continue;
+			}
+			loaded = read(directory + "/" + file->d_name, textureID, width, height);
+		}
+		closedir(listing);
+		return loaded;
+	}
+
+private:
+	bool read (const std::string& path, const unsigned long textureID, const unsigned int width, const unsigned int height) {
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file) {
+			fprintf(stderr, "cannot open %s\n", path.c_str());
+			return false;
+		}
+
+		Image& image = images[textureID];
+		image.width = width;
+		image.height = height;
+		image.pixels.resize((size_t)width * height);
+		const bool complete = image.pixels.empty() || fread(&image.pixels[0], sizeof(uint32_t), image.pixels.size(), file) == image.pixels.size();
+		fclose(file);
+		if (!complete) {
+			fprintf(stderr, "%s is shorter than %ux%u pixels\n", path.c_str(), width, height);
+		}
+		return complete;
+	}
+};
+
+#endif
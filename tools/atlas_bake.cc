@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "../src/MaxRectsAtlas.cpp"
+#include "../src/AtlasFile.cpp"
+#include "DirectoryImageSource.cpp"
+
+// Packs a directory of raw images into atlas pages ahead of time and writes a baked atlas
+// file for BakedAtlas to map at startup. Images are trimmed of transparent borders,
+// identical ones share a region, and the tallest are placed first. A page hint file from
+// atlas_group ("<id> <page>" per line) makes each hinted texture go on its page when it fits;
+// textures are then placed page by page.
+//
+//   atlas_bake <image_dir> <output.atlas> [page_size] [page_limit] [gutter] [page_hints]
+
+static DirectoryImageSource* g_source = NULL;
+static std::map<unsigned long, unsigned int> g_hints;
+
+static unsigned int hintFor(const unsigned long textureID) {
+	std::map<unsigned long, unsigned int>::const_iterator hint = g_hints.find(textureID);
+	return hint == g_hints.end() ? ~0u : hint->second;
+}
+
+static bool placesFirst(const unsigned long left, const unsigned long right) {
+	if (hintFor(left) != hintFor(right)) {
+		return hintFor(left) < hintFor(right);
+	}
+	const DirectoryImageSource::Image& first = g_source->images[left];
+	const DirectoryImageSource::Image& second = g_source->images[right];
+	if (first.height != second.height) {
+		return first.height > second.height;
+	}
+	return first.width > second.width;
+}
+
+static bool loadHints(const char* path) {
+	FILE* file = fopen(path, "r");
+	if (!file) {
+		fprintf(stderr, "cannot open %s\n", path);
+		return false;
+	}
+	unsigned long textureID;
+	unsigned int page;
+	while (fscanf(file, "%lu %u", &textureID, &page) == 2) {
+		g_hints[textureID] = page;
+	}
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <image_dir> <output.atlas> [page_size] [page_limit] [gutter] [page_hints]\n", argv[0]);
+		return 2;
+	}
+	const unsigned int pageSize = argc > 3 ? (unsigned int)atoi(argv[3]) : 2048;
+	const size_t pageLimit = argc > 4 ? (size_t)atoi(argv[4]) : 16;
+	const unsigned int gutter = argc > 5 ? (unsigned int)atoi(argv[5]) : 1;
+
+	DirectoryImageSource source;
+	if (!source.load(argv[1]) || (argc > 6 && !loadHints(argv[6]))) {
+		return 1;
+	}
+
+	std::vector<unsigned long> textureIDs;
+	for (std::map<unsigned long, DirectoryImageSource::Image>::const_iterator image = source.images.begin(); image != source.images.end(); ++image) {
+		textureIDs.push_back(image->first);
+	}
+	g_source = &source;
+	std::stable_sort(textureIDs.begin(), textureIDs.end(), placesFirst);
+
+	MaxRectsAtlas atlas(&source, pageSize, pageSize, pageLimit);
+	atlas.setGutter(gutter);
+	atlas.enableBackingStore();
+	atlas.enableTrimming();
+	atlas.enableDeduplication();
+	for (std::map<unsigned long, unsigned int>::const_iterator hint = g_hints.begin(); hint != g_hints.end(); ++hint) {
+		atlas.setPageHint(hint->first, hint->second);
+	}
+
+	size_t unhinted = 0;
+	for (size_t i = 0; i < textureIDs.size(); ++i) {
+		const AtlasedTexture* texture = atlas.addTexture(textureIDs[i]);
+		if (!texture) {
+			fprintf(stderr, "texture %lu does not fit in %lu %ux%u pages\n", textureIDs[i], (unsigned long)pageLimit, pageSize, pageSize);
+			return 1;
+		}
+		unhinted += !g_hints.empty() && texture->layer != hintFor(textureIDs[i]);
+	}
+
+	if (!writeAtlasFile(argv[2], atlas, textureIDs)) {
+		fprintf(stderr, "cannot write %s\n", argv[2]);
+		return 1;
+	}
+
+	printf("%lu textures (%lu shared) in %lu %ux%u pages, %.2f%% occupancy\n", (unsigned long)textureIDs.size(), (unsigned long)atlas.duplicateCount(),
+		(unsigned long)atlas.pageCount(), pageSize, pageSize, atlas.occupancy() * 100.0f);
+	if (!g_hints.empty()) {
+		printf("%lu textures off their hinted page\n", (unsigned long)unhinted);
+	}
+	return 0;
+}
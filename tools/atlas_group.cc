@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <vector>
+#include "../src/MaxRectsAtlas.cpp"
+#include "../src/AtlasPixels.cpp"
+#include "../src/PageGrouping.cpp"
+#include "DirectoryImageSource.cpp"
+
+// Assigns textures to atlas pages so that textures recorded drawing together share a page,
+// and writes the assignment as "<id> <page>" lines for atlas_bake or PackedAtlas page hints.
+// The statistics come from CooccurrenceRecorder::save(), possibly several runs concatenated.
+// Sizes are the images' trimmed sizes plus the gutter on each side, as atlas_bake packs them.
+// Reports the recorded pair counts split across pages with plain first-fit packing and with
+// the grouping: each one a frame in which a batch key needed another batch.
+//
+//   atlas_group <statistics.txt> <image_dir> <page_hints.txt> [page_size] [page_limit] [gutter]
+
+static GroupedTexture measure(const unsigned long textureID, const DirectoryImageSource::Image& image, const unsigned int gutter) {
+	// A fully transparent image keeps one pixel, as in PackedAtlas.
+	unsigned int x, y;
+	GroupedTexture texture = { textureID, 1, 1 };
+	if (!image.pixels.empty()) {
+		AtlasPixels::opaqueBounds(&image.pixels[0], image.width, image.height, x, y, texture.width, texture.height);
+	}
+	texture.width += 2 * gutter;
+	texture.height += 2 * gutter;
+	return texture;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s <statistics.txt> <image_dir> <page_hints.txt> [page_size] [page_limit] [gutter]\n", argv[0]);
+		return 2;
+	}
+	const unsigned int pageSize = argc > 4 ? (unsigned int)atoi(argv[4]) : 2048;
+	const size_t pageLimit = argc > 5 ? (size_t)atoi(argv[5]) : 16;
+	const unsigned int gutter = argc > 6 ? (unsigned int)atoi(argv[6]) : 1;
+
+	CooccurrenceRecorder statistics;
+	if (!statistics.load(argv[1])) {
+		fprintf(stderr, "cannot read statistics from %s\n", argv[1]);
+		return 1;
+	}
+	DirectoryImageSource source;
+	if (!source.load(argv[2])) {
+		return 1;
+	}
+
+	std::vector<GroupedTexture> textures;
+	for (std::map<unsigned long, DirectoryImageSource::Image>::const_iterator image = source.images.begin(); image != source.images.end(); ++image) {
+		textures.push_back(measure(image->first, image->second, gutter));
+	}
+
+	MaxRectsPacker prototype(pageSize, pageSize);
+	PageGrouping grouping(prototype, pageLimit);
+	std::map<unsigned long, unsigned int> firstFit, grouped;
+	if (!grouping.assignFirstFit(textures, firstFit) || !grouping.assign(textures, statistics, grouped)) {
+		fprintf(stderr, "textures do not fit in %lu %ux%u pages\n", (unsigned long)pageLimit, pageSize, pageSize);
+		return 1;
+	}
+
+	FILE* output = fopen(argv[3], "w");
+	if (!output) {
+		fprintf(stderr, "cannot write %s\n", argv[3]);
+		return 1;
+	}
+	for (std::map<unsigned long, unsigned int>::const_iterator page = grouped.begin(); page != grouped.end(); ++page) {
+		fprintf(output, "%lu %u\n", page->first, page->second);
+	}
+	if (fclose(output) != 0) {
+		fprintf(stderr, "cannot write %s\n", argv[3]);
+		return 1;
+	}
+
+	printf("%lu textures over %llu frames: split pairs %llu with first fit, %llu grouped\n", (unsigned long)textures.size(), statistics.frames(),
+		PageGrouping::splitWeight(statistics, firstFit), PageGrouping::splitWeight(statistics, grouped));
+	return 0;
+}